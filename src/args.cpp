@@ -1,5 +1,9 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
+#include <sstream>
 #include <string>
 using namespace std;
 
@@ -7,11 +11,12 @@ using namespace std;
 #include "index.h"
 #include "util.h"
 #include <getopt.h>
+#include <unistd.h>
 
 // globally accessible arguments for convenience
 Args args;
 
-static char const opts_short[] = "hw:k:islr:n:f:pgb";
+static char const opts_short[] = "hw:k:islzr:n:f:m:T:t:j:M:pgbo:";
 static struct option const opts[] = {
     {"help", no_argument, nullptr, 'h'},
     {"window-size", required_argument, nullptr, 'w'},
@@ -19,34 +24,54 @@ static struct option const opts[] = {
     {"load-index", no_argument, nullptr, 'i'},
     {"save-index", no_argument, nullptr, 's'},
     {"list-index", no_argument, nullptr, 'l'},
+    {"compress-index", no_argument, nullptr, 'z'},
     {"rename-regions", required_argument, nullptr, 'r'},
     {"seq", required_argument, nullptr, 'n'},
     {"batchfile", required_argument, nullptr, 'f'},
+    {"memory", required_argument, nullptr, 'm'},
+    {"tmpdir", required_argument, nullptr, 'T'},
+    {"threads", required_argument, nullptr, 't'},
+    {"jobs", required_argument, nullptr, 'j'},
+    {"max-memory", required_argument, nullptr, 'M'},
     {"print-factors", no_argument, nullptr, 'p'},
     {"graph", required_argument, nullptr, 'g'},
     {"benchmark", no_argument, nullptr, 'b'},
+    {"output-format", required_argument, nullptr, 'o'},
     {0, 0, 0, 0} // <- required
 };
 
 static char const usage[] = PROGNAME
     " " VERSION " (" BUILD_INFO ")\n" DESCRIPTION "\n" COPYRIGHT "\n"
-    "Usage: " PROGNAME " [OPTIONS] FILE\n"
+    "Usage: " PROGNAME " [OPTIONS] FILE...\n"
     "OPTIONS:\n"
-    "\t-w NUM: size of sliding window (default: whole sequence length)\n"
-    "\t-k NUM: interval between sliding windows (default: w/10)\n"
+    "\t-w NUM[,NUM...]: size of sliding window (default: whole sequence length),\n"
+    "\t   several sizes give one column each\n"
+    "\t-k NUM[,NUM...]: interval between sliding windows (default: smallest w/10),\n"
+    "\t   one for all window sizes or one for each\n"
 
     "\t-i: use index file instead of FASTA sequence file\n"
     "\t-s: output index file for further processing (no regular result)\n"
     "\t-l: list sequences stored in index file\n"
+    "\t-z: compress match factors in index file (with -s)\n"
     "\t-r FILE: rename sequences in index file to names provided in FILE\n"
     "\t-n IDX:FROM-TO: calculate for given sequence and region within file\n"
     "\t   (defaults: IDX=0, FROM=0, TO=end of whole sequence. valid syntax: IDX | IDX:FROM-TO)\n"
     "\t-f FILE: file that contains a list of regions to process\n"
     "\t   (syntax like for -n with one triple per line, not usable with -w)\n"
+    "\t-m NUM: sort suffixes in scratch files using about NUM MB of memory\n"
+    "\t   (besides the sequence itself, default: sort in memory)\n"
+    "\t-T DIR: directory for scratch files (default: $TMPDIR or /tmp)\n"
+    "\t-t NUM: number of threads (default: 1)\n"
+    "\t-j NUM: number of files processed at the same time, with -t threads each\n"
+    "\t   (default: 1, -s writes the index of each FILE to FILE.idx)\n"
+    "\t-M NUM: start no file while the estimated memory of the running ones and\n"
+    "\t   this one exceeds NUM MB (default: physical memory)\n"
 
     "\t-p: print match factors\n"
     "\t-b: print benchmarking information\n"
     "\t-g: output to plot with macle.sh (gnuplot wrapper)\n"
+    "\t-o FORMAT: format of the results: text, bedgraph, binary or zoom\n"
+    "\t   (default: text, binary and zoom are float32 tracks, see README)\n"
     "\t-h: print this help message and exit\n";
 
 bool stol_or_fail(string s, size_t &n) {
@@ -58,6 +83,20 @@ bool stol_or_fail(string s, size_t &n) {
   return true;
 }
 
+// parse comma separated list of numbers
+bool parseList(string str, vector<uint32_t> &v) {
+  v.clear();
+  stringstream ss(str);
+  string item;
+  while (getline(ss, item, ',')) {
+    size_t x;
+    if (!stol_or_fail(item, x) || x > UINT32_MAX)
+      return false;
+    v.push_back(x);
+  }
+  return !v.empty();
+}
+
 Task::Task(int64_t i, size_t s, size_t e) : lbl(""), idx(i), start(s), end(e), num(0) {}
 bool Task::parse(string str) {
   size_t sep = str.find(":");
@@ -98,10 +137,18 @@ void Args::parse(int argc, char *argv[]) {
       exit(0);
       break;
     case 'w':
-      args.w = atoi(optarg);
+      if (!parseList(optarg, args.w)) {
+        cerr << "ERROR: invalid window size list \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      if (args.w.size() == 1 && args.w[0] == 0) // whole sequence
+        args.w.clear();
       break;
     case 'k':
-      args.k = atoi(optarg);
+      if (!parseList(optarg, args.k)) {
+        cerr << "ERROR: invalid window interval list \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
       break;
 
     case 'i':
@@ -113,6 +160,9 @@ void Args::parse(int argc, char *argv[]) {
     case 'l':
       args.l = true;
       break;
+    case 'z':
+      args.z = true;
+      break;
     case 'n':
       if (!args.tasks.empty()) {
         cerr << "ERROR: -n incompatible with -f!" << endl;
@@ -144,6 +194,39 @@ void Args::parse(int argc, char *argv[]) {
       }))
         exit(1);
       break;
+    case 'm':
+      if (!stol_or_fail(optarg, args.m) || args.m == 0) {
+        cerr << "ERROR: invalid memory budget \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      break;
+    case 'T':
+      args.tmpdir = optarg;
+      break;
+    case 't': {
+      size_t num;
+      if (!stol_or_fail(optarg, num) || num == 0 || num > 1024) {
+        cerr << "ERROR: invalid number of threads \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      args.threads = (unsigned)num;
+      break;
+    }
+    case 'j': {
+      size_t num;
+      if (!stol_or_fail(optarg, num) || num == 0 || num > 1024) {
+        cerr << "ERROR: invalid number of jobs \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      args.jobs = (unsigned)num;
+      break;
+    }
+    case 'M':
+      if (!stol_or_fail(optarg, args.maxmem) || args.maxmem == 0) {
+        cerr << "ERROR: invalid memory budget \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      break;
     case 'r':
       if (!with_file_in(optarg, [&](istream &in){
         string line;
@@ -182,6 +265,20 @@ void Args::parse(int argc, char *argv[]) {
     case 'b':
       args.b = true;
       break;
+    case 'o':
+      if (!strcmp(optarg, "text"))
+        args.o = OutFormat::Text;
+      else if (!strcmp(optarg, "bedgraph"))
+        args.o = OutFormat::BedGraph;
+      else if (!strcmp(optarg, "binary"))
+        args.o = OutFormat::Binary;
+      else if (!strcmp(optarg, "zoom"))
+        args.o = OutFormat::Zoom;
+      else {
+        cerr << "ERROR: unknown output format \"" << optarg << "\"!" << endl;
+        exit(1);
+      }
+      break;
 
     case '?': // automatic error message from getopt
       exit(1);
@@ -194,6 +291,9 @@ void Args::parse(int argc, char *argv[]) {
     }
   }
 
+  if (args.tmpdir.empty())
+    args.tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
   //no tasks given -> global complexity of whole sequence
   if (args.tasks.empty())
     args.tasks.push_back(Task(-1,0,0));
@@ -204,12 +304,44 @@ void Args::parse(int argc, char *argv[]) {
     args.files = &argv[optind];
   }
 
-  if (args.num_files > 1)
-    cerr << "WARNING: processing only first file: " << args.files[0] << endl;
-  if (args.w && args.tasks.size()>1) {
+  if (args.maxmem == 0)
+    args.maxmem = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE) >> 20;
+  if (args.num_files > 1 && (args.g || args.o == OutFormat::Binary || args.o == OutFormat::Zoom) &&
+      !args.s && !args.l) {
+    cerr << "ERROR: can not use -g or binary output formats with several files!" << endl;
+    exit(1);
+  }
+  if (args.num_files > 1 && args.jobs > 1 && args.p) {
+    cerr << "ERROR: can not use -p with several jobs (-j)!" << endl;
+    exit(1);
+  }
+  if (args.num_files > 1 && !args.newnames.empty())
+    cerr << "WARNING: renaming only the first file: " << args.files[0] << endl;
+  if (find(args.w.begin(), args.w.end(), 0) != args.w.end()) {
+    cerr << "ERROR: window sizes in a list must be positive!" << endl;
+    exit(1);
+  }
+  if (args.k.size() > 1 && args.k.size() != args.w.size()) {
+    cerr << "ERROR: need one window interval (-k) for all or for each window size (-w)!" << endl;
+    exit(1);
+  }
+  if (args.g && args.k.size() > 1 && count(args.k.begin(), args.k.end(), args.k[0]) != (int64_t)args.k.size()) {
+    cerr << "ERROR: can not use -g with different window intervals!" << endl;
+    exit(1);
+  }
+  if (!args.w.empty() && args.tasks.size()>1) {
     cerr << "ERROR: can not use sliding window (-w) and batch mode (-f) at the same time!" << endl;
     exit(1);
   }
+  if (args.o != OutFormat::Text && (args.g || args.tasks.size()>1)) {
+    cerr << "ERROR: can not use -o with -g or batch mode (-f)!" << endl;
+    exit(1);
+  }
+  if ((args.o == OutFormat::Binary || args.o == OutFormat::Zoom) && args.k.size() > 1 &&
+      count(args.k.begin(), args.k.end(), args.k[0]) != (int64_t)args.k.size()) {
+    cerr << "ERROR: binary output formats need a single window interval!" << endl;
+    exit(1);
+  }
   if (args.g && args.tasks.size()>1) {
     cerr << "ERROR: can not use -g and batch mode (-f) at the same time!" << endl;
     exit(1);
@@ -11,12 +11,10 @@
 
 #ifdef USE_SDSL
 #define BUILD_INFO "with SDSL"
+#elif defined(PACKED40)
+#define BUILD_INFO "32/40 bit"
 #else
-#ifdef U64
-#define BUILD_INFO "64 bit"
-#else
-#define BUILD_INFO "32 bit"
-#endif
+#define BUILD_INFO "32/64 bit"
 #endif
 
 struct Task {
@@ -29,22 +27,33 @@ struct Task {
   bool parse(std::string str);
 };
 
+// formats of sliding window results
+enum class OutFormat { Text, BedGraph, Binary, Zoom };
+
 struct Args {
   void parse(int argc, char *argv[]);
 
   bool h = false; // help message?
 
-  uint32_t w = 0;  // sliding window size
-  uint32_t k = 0;  // sliding interval
+  std::vector<uint32_t> w;  // sliding window sizes (empty: whole sequence)
+  std::vector<uint32_t> k;  // sliding intervals (one for all or one per window size)
 
   bool i = false;  // use index (intermediate data)
   bool s = false;  // output index
   bool l = false;  // list contents of index
+  bool z = false;  // compress factors in saved index
   std::vector<Task> tasks;  // number of sequence/region (+ offsets) in index file to work on
   std::vector<std::string> newnames; //new names for regions -> rename regions in index
 
+  size_t m = 0;    // memory budget (MB) for external suffix sorting, 0 = in memory
+  std::string tmpdir; // directory for scratch files
+  unsigned threads = 1; // number of threads
+  unsigned jobs = 1;    // number of files processed at the same time
+  size_t maxmem = 0;    // memory budget (MB) of the files processed at the same time
+
   bool p = false;  // print match length decomposition?
   bool g = false;  // output for ./macle_plot.sh
+  OutFormat o = OutFormat::Text; // format of the results
   bool b = false;  // benchmark run
 
   // non-parameter arguments
@@ -7,7 +7,8 @@ using namespace std::chrono;
 
 #include "args.h"
 
-static stack<high_resolution_clock::time_point> tp;
+// per thread, files processed at the same time are timed separately
+static thread_local stack<high_resolution_clock::time_point> tp;
 
 void tick() { if (args.b) tp.push(high_resolution_clock::now()); }
 
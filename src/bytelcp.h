@@ -0,0 +1,102 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// LCP array with one byte per entry. Values from ESC upwards are marked with
+// ESC and kept in an exception table sorted by index. Entries written in
+// increasing index order keep the table sorted, otherwise finalize() has to
+// be called before reading large values. Only Esa uses it: index building
+// (computeMLFactPlcp) turns the Phi array into PLCP in place and has no LCP
+// array of its own.
+class ByteLcp {
+public:
+  static const uint8_t ESC = 255;
+
+  // reference to a single entry
+  class Ref {
+  public:
+    Ref(ByteLcp &l, size_t j) : lcp(l), i(j) {}
+    operator uint64_t() const { return ((ByteLcp const &)lcp)[i]; }
+    Ref &operator=(uint64_t x) {
+      lcp.set(i, x);
+      return *this;
+    }
+    Ref &operator=(Ref const &r) { return *this = (uint64_t)r; }
+
+  private:
+    ByteLcp &lcp;
+    size_t i;
+  };
+
+  ByteLcp() {}
+  explicit ByteLcp(size_t n) : dat(n, 0) {}
+
+  size_t size() const { return dat.size(); }
+  void resize(size_t n) { dat.resize(n, 0); }
+  void swap(ByteLcp &o) {
+    dat.swap(o.dat);
+    large.swap(o.large);
+    std::swap(sorted, o.sorted);
+  }
+
+  uint64_t operator[](size_t i) const { return dat[i] < ESC ? dat[i] : lookup(i); }
+  Ref operator[](size_t i) { return Ref(*this, i); }
+
+  // max(lcp[i], lcp[i+1]), the match length of suffix i
+  uint64_t max2(size_t i) const {
+    uint8_t a = dat[i], b = dat[i + 1];
+    if (a < ESC && b < ESC)
+      return std::max(a, b);
+    return std::max((*this)[i], (*this)[i + 1]);
+  }
+
+  // write only the byte of entry i, returns false if x has to be passed to
+  // set() later. Distinct entries can be written concurrently this way.
+  bool setSmall(size_t i, uint64_t x) {
+    dat[i] = x < ESC ? (uint8_t)x : ESC;
+    return x < ESC;
+  }
+
+  void set(size_t i, uint64_t x) {
+    if (setSmall(i, x))
+      return;
+    if (!large.empty() && large.back().first == i)
+      large.back().second = x;
+    else {
+      if (!large.empty() && large.back().first > i)
+        sorted = false;
+      large.push_back(std::make_pair(i, x));
+    }
+  }
+
+  // sort the exception table, for equal indices the last written value wins
+  void finalize() {
+    if (!sorted) {
+      std::stable_sort(large.begin(), large.end(),
+                       [](std::pair<size_t, uint64_t> const &a,
+                          std::pair<size_t, uint64_t> const &b) { return a.first < b.first; });
+      std::vector<std::pair<size_t, uint64_t>> uniq;
+      for (size_t j = 0; j < large.size(); j++)
+        if (j + 1 == large.size() || large[j + 1].first != large[j].first)
+          uniq.push_back(large[j]);
+      large.swap(uniq);
+      sorted = true;
+    }
+    large.shrink_to_fit();
+  }
+
+  // number of values stored in the exception table
+  size_t numLarge() const { return large.size(); }
+
+private:
+  uint64_t lookup(size_t i) const {
+    auto it = std::lower_bound(large.begin(), large.end(), std::make_pair(i, (uint64_t)0));
+    return it->second;
+  }
+
+  std::vector<uint8_t> dat;
+  std::vector<std::pair<size_t, uint64_t>> large;
+  bool sorted = true;
+};
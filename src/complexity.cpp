@@ -1,19 +1,22 @@
-#include <queue>
 #include <cassert>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 using namespace std;
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL // selected at runtime if the cpu supports it
+#endif
+
 #include "args.h"  //args.p
 #include "bench.h" //ticktock
 #include "complexity.h"
 #include "index.h"
 #include "matchlength.h"
+#include "parallel.h"
 #include "shulen.h"
 
-// input: prefix-sum array, left and right bound (inclusive)
-#define sumFromTo(a, l, r) ((a)[(r)] - ((l) ? (a)[(l)-1] : 0))
-
 // number of sliding windows with width w that fit into n with step k
 size_t numEntries(size_t n, size_t w, size_t k) {
   assert(w <= n);
@@ -23,57 +26,70 @@ size_t numEntries(size_t n, size_t w, size_t k) {
   return (n - w) / k + 1;
 }
 
-// usage: for each_window(total, windowsize, step) -> sets j,l,r in each iteration
-#define each_window(n, w, k)                                                             \
-  (size_t numj = numEntries(n, w, k), j = 0, l = j * k, r = min(n, l + w) - 1; j < numj; \
-   j++, l = j * k, r = min(n, l + w) - 1)
-
-// given sequence length, desired window and step size and a list of intervals
-// with invalid nucleotides, returns a list of windows (iteration numbers) that
-// should be ignored in the complexity calculation
-queue<size_t> calcNAWindows(size_t offset, size_t n, size_t w, size_t k,
-                             vector<pair<size_t, size_t>> const &badiv) {
-  queue<size_t> na;
-  list<pair<size_t,size_t>> bad;
-  auto currbad = badiv.begin();
-
-  for
-    each_window(n, w, k) {
-      //kick out intervals that are now outside of window
-      for (auto it=bad.begin(); it != bad.end(); it++)
-        if (it->second < l+offset) {
-          it = bad.erase(it);
-          it--;
-        }
-      //add possible new bad intervals
-      while (currbad != badiv.end() && currbad->first <= r+offset) {
-        bad.push_back(*currbad);
-        currbad++;
-      }
-
-      size_t sum = 0;
-      for (auto &i : bad)
-        sum += max(i.first, l+offset) - min(r+offset, i.second) + 1;
-      if ((double)sum / (double)w > 0.05)
-        na.push(j);
-    }
-  return na;
+// number of bad nucleotides before a position, from the prefix sums of the
+// lengths of the sorted bad intervals
+class BadCounts {
+public:
+  // for the m intervals at bad
+  BadCounts(pair<size_t, size_t> const *bad, size_t m) : iv(bad), n(m), cum(m + 1, 0) {
+    for (size_t j = 0; j < n; j++)
+      cum[j + 1] = cum[j] + iv[j].second - iv[j].first + 1;
+  }
+
+  // number of intervals starting before position i
+  size_t find(size_t i) const {
+    return lower_bound(iv, iv + n, i, [](pair<size_t, size_t> const &a, size_t x) {
+             return a.first < x;
+           }) - iv;
+  }
+
+  // bad nucleotides in [0, i), j is find(i) of a smaller i and is moved
+  // forward, so increasing positions take amortized constant time
+  size_t before(size_t i, size_t &j) const {
+    while (j < n && iv[j].first < i)
+      j++;
+    if (j == 0)
+      return 0;
+    return cum[j - 1] + min(i, iv[j - 1].second + 1) - iv[j - 1].first;
+  }
+
+private:
+  pair<size_t, size_t> const *iv;
+  size_t n;
+  vector<size_t> cum; // bad nucleotides in the intervals before each one
+};
+
+// index of the region starting at offset with length len, -1 if there is none
+// or its statistics are not known
+template <typename T>
+int64_t statsRegion(size_t offset, size_t len, ComplexityData<T> const &dat) {
+  if (dat.regionStats.size() != dat.regions.size())
+    return -1;
+  auto it = lower_bound(dat.regions.begin(), dat.regions.end(), make_pair(offset, (size_t)0));
+  for (; it != dat.regions.end() && it->first == offset; it++)
+    if (it->second == len)
+      return it - dat.regions.begin();
+  return -1;
 }
 
 //get number of bad nucleotides in given interval of given sequence data
-pair<size_t,size_t> numBad(size_t offset, size_t len, ComplexityData const &dat) {
+template <typename T>
+pair<size_t,size_t> numBad(size_t offset, size_t len, ComplexityData<T> const &dat) {
   if (offset==0 && len==dat.len)
     return make_pair(dat.numbad, dat.bad.size()); //stored in data
+  int64_t reg = statsRegion(offset, len, dat);
+  if (reg >= 0)
+    return make_pair(dat.regionStats[reg].numbad, dat.regionStats[reg].badivs);
 
   size_t sum = 0;
   size_t ivs = 0;
   auto it = lower_bound(dat.bad.begin(),dat.bad.end(),make_pair(offset,offset),
       [](pair<size_t,size_t> a, pair<size_t,size_t> b){return a.second < b.second;});
-  if (it != dat.bad.begin() && it->first < offset)
+  if (it != dat.bad.begin() && it != dat.bad.end() && it->first < offset)
     it--;
 
   while (it != dat.bad.end() && it->first < offset+len) {
-    int64_t add = max((int64_t)0, (int64_t)min(offset+len, it->second) - (int64_t)max(it->first, offset) + 1L);
+    int64_t add = max((int64_t)0, (int64_t)min(offset+len-1, it->second) - (int64_t)max(it->first, offset) + 1L);
     // cerr << it->first << " - " << it->second << " -> " << add << endl;
     sum += add;
     ivs++;
@@ -82,89 +98,176 @@ pair<size_t,size_t> numBad(size_t offset, size_t len, ComplexityData const &dat)
   return make_pair(sum,ivs);
 }
 
+template <typename T> MlNorm mlNorm(ComplexityData<T> const &dat) {
+  MlNorm norm;
+  // calculations (per nucleotide)
+  norm.cMin = 2.0 / (dat.len - dat.numbad); // at least 2 factors an any sequence, like AAAAAA.A
+
+  // some wildly advanced estimation for avg. shulen length,
+  // 2n because matches are from both strands
+  norm.esl = expShulen(dat.gc, 2 * (dat.len - dat.numbad));
+
+  // expected # of match length factors / nucleotide
+  double cAvg = 1.0 / (norm.esl - 1.0);
+  // only subtract cMin if its not a degenerate case
+  norm.cNorm = cAvg - norm.cMin > 0 ? cAvg - norm.cMin : cAvg;
+  return norm;
+}
+
+// y[j] = max(0, (y[j] / w - cMin) / cNorm) for the factor counts y[j] of
+// m windows, negative entries (ignored windows) are kept
+static void scaleCountsScalar(double *y, size_t m, double w, double cMin, double cNorm) {
+  for (size_t j = 0; j < m; j++)
+    if (y[j] >= 0)
+      y[j] = max(0., (y[j] / w - cMin) / cNorm);
+}
+
+#ifdef HAVE_AVX2_KERNEL
+// same as scaleCountsScalar, 4 windows at a time (divisions and max are
+// exact, so the values are the same)
+__attribute__((target("avx2")))
+static void scaleCountsAvx2(double *y, size_t m, double w, double cMin, double cNorm) {
+  __m256d vw = _mm256_set1_pd(w), vmin = _mm256_set1_pd(cMin), vnorm = _mm256_set1_pd(cNorm);
+  __m256d zero = _mm256_setzero_pd();
+  size_t j = 0;
+  for (; j + 4 <= m; j += 4) {
+    __m256d c = _mm256_loadu_pd(y + j);
+    __m256d v = _mm256_div_pd(_mm256_sub_pd(_mm256_div_pd(c, vw), vmin), vnorm);
+    v = _mm256_max_pd(v, zero); // 0 for NaN and -0, like max(0., v)
+    _mm256_storeu_pd(y + j, _mm256_blendv_pd(v, c, _mm256_cmp_pd(c, zero, _CMP_LT_OQ)));
+  }
+  scaleCountsScalar(y + j, m - j, w, cMin, cNorm);
+}
+#endif
+
+void scaleCounts(double *y, size_t m, double w, double cMin, double cNorm, bool simd) {
+#ifdef HAVE_AVX2_KERNEL
+  static bool const avx2 = __builtin_cpu_supports("avx2");
+  if (simd && avx2)
+    return scaleCountsAvx2(y, m, w, cMin, cNorm);
+#endif
+  scaleCountsScalar(y, m, w, cMin, cNorm);
+}
+
+// everything the window kernels need about a query
+template <typename T> struct WindowQuery {
+  ComplexityData<T> const &dat;
+  size_t offset, n, w, k;
+  size_t shift;          // start of the first window relative to offset
+  int64_t reg;           // region [offset, offset+n) with statistics, or -1
+  size_t numbad, badivs; // bad nucleotides / intervals in [offset, offset+n)
+  MlNorm norm;
+  BadCounts badc;        // only set for sliding windows
+
+  // observed number of match factors in window [l, r], counting the
+  // region start as factor start
+  uint64_t numFacts(size_t l, size_t r) const {
+    if (reg >= 0 && l == 0 && r + 1 == n)
+      return dat.regionStats[reg].facts;
+    uint64_t cnt = dat.factBits.rank(offset + r + 1) - dat.factBits.rank(offset + max(l, (size_t)1));
+    return l == 0 ? cnt + 1 : cnt;
+  }
+};
+
+// complexities of windows [from, to) into y. Global: the one window is the
+// whole sequence without its bad nucleotides, Print: explain the values (-p)
+template <bool Global, bool Print, typename T>
+static void windowKernel(WindowQuery<T> const &q, size_t from, size_t to, double *y) {
+  double cMin = q.norm.cMin, cNorm = q.norm.cNorm;
+  if (Global) { //global complexity -> ignore NNNN... blocks, as if they are not there
+    int64_t numfacs = (int64_t)q.numFacts(0, q.n - 1);
+    numfacs -= q.badivs;     //subtract number of bad intervals from total
+    numfacs = max((int64_t)1, numfacs); //bugfix: sometimes there are more bad ivs than factors!
+    double effectiveW = q.w - q.numbad; //we ignore the N-blocks
+    double cObs = (double)numfacs / effectiveW;
+    y[0] = max(0., (cObs  - cMin) / cNorm); //need max for corner case of no matches inside window
+    if (Print) {
+      cout << "observed match factors: " << numfacs << endl;
+      cout << "observed match factors per nucleotide: " << cObs << endl;
+      cout << "mlComplexity = avgPerNucl / estimated = "
+            << cObs << "/" << cNorm << " = " << y[0] << endl;
+    }
+    return;
+  }
+
+  // factor counts, -1 for windows with more than 5% bad nucleotides
+  size_t bl = q.badc.find(q.offset + q.shift + from * q.k), br = bl;
+  for (size_t j = from; j < to; j++) {
+    size_t l = q.shift + j * q.k, r = min(q.n, l + q.w) - 1;
+    size_t nb = q.badc.before(q.offset + r + 1, br) - q.badc.before(q.offset + l, bl);
+    y[j] = (double)nb / (double)q.w > 0.05 ? -1 : (double)q.numFacts(l, r);
+  }
+  if (!Print) {
+    scaleCounts(y + from, to - from, q.w, cMin, cNorm);
+    return;
+  }
+  for (size_t j = from; j < to; j++) {
+    if (y[j] < 0)
+      continue;
+    int64_t numfacs = (int64_t)y[j];
+    double cObs = (double)numfacs / q.w;
+    y[j] = max(0., (cObs  - cMin) / cNorm);
+    cout << "observed match factors: " << numfacs << endl;
+    cout << "observed match factors per nucleotide: " << cObs << endl;
+    cout << "mlComplexity = avgPerNucl / estimated = "
+          << cObs << "/" << cNorm << " = " << y[j] << endl;
+  }
+}
+
 // calculate match length complexity for sliding windows
 // input: sequence length, sane w and k, allocated array for results, extracted data
-void mlComplexity(size_t offset, size_t n, size_t w, size_t k, vector<double> &y, ComplexityData const &dat) {
+template <typename T>
+void mlComplexity(size_t offset, size_t n, size_t w, size_t k, vector<double> &y, ComplexityData<T> const &dat,
+                  MlNorm const &norm, ostream &log, size_t shift) {
   bool globalMode = n==w;
   auto badpart = numBad(offset, n, dat);
-  size_t numbad = badpart.first;
-  size_t badivs = badpart.second;
-
-  // compute observed number of match factors for every prefix
-  vector<size_t> ps(n);
-  size_t nextfact = lower_bound(dat.mlf.begin(),dat.mlf.end(),offset+1,[](size_t a,size_t b){return a<b;})-dat.mlf.begin();
-  ps[0] = 1;
-  for (size_t i = 1; i < n; i++) {
-    ps[i] = ps[i - 1];
-    if (nextfact < dat.mlf.size() && i+offset == dat.mlf[nextfact]) {
-      ps[i]++;
-      nextfact++;
-    }
-  }
-
-  // calculations (per nucleotide)
-  double cMin = 2.0 / (dat.len - dat.numbad); // at least 2 factors an any sequence, like AAAAAA.A
+  // windows with more than 5% bad nucleotides are ignored
+  WindowQuery<T> q{dat, offset, n, w, k, shift, statsRegion(offset, n, dat), badpart.first, badpart.second,
+                   norm, BadCounts(dat.bad.data(), globalMode ? 0 : dat.bad.size())};
 
-  // some wildly advanced estimation for avg. shulen length,
-  // 2n because matches are from both strands
-  double esl = expShulen(dat.gc, 2 * (dat.len - dat.numbad));
-  if (globalMode) { //global complexity -> ignore NNNN... blocks, as if they are not there
-    double fracbad = (double)numbad / (double)n;
+  if (globalMode) {
+    double fracbad = (double)q.numbad / (double)n;
     // cerr << fracbad << endl;
     if (fracbad > 0.05) {
-      cerr << "WARNING: only " << (1-fracbad)*100 << "\% of sequence are valid DNA! "
-           << "Ignoring " << badivs << " bad intervals..." << endl;
+      log << "WARNING: only " << (1-fracbad)*100 << "\% of sequence are valid DNA! "
+           << "Ignoring " << q.badivs << " bad intervals..." << endl;
     }
   }
 
-  // expected # of match length factors / nucleotide
-  double cAvg = 1.0 / (esl - 1.0);
-  // only subtract cMin if its not a degenerate case
-  double cNorm = cAvg - cMin > 0 ? cAvg - cMin : cAvg;
-
   if (args.p) {
-    cout  << "expected match factor length: " << esl-1 << endl;
-    cout << "expected match factors per nucleotide: " << cNorm << endl;
-  }
-
-  // get bad window indices for given parameters
-  queue<size_t> badj = calcNAWindows(offset, n, w, k, dat.bad);
-  for
-    each_window(n, w, k) {
-      if (!globalMode)
-        if (!badj.empty() && j == badj.front()) {
-          y[j] = -1;
-          badj.pop();
-          continue;
-        }
-
-      int64_t numfacs = (int64_t)sumFromTo(ps, l, r);
-      double effectiveW = w;
-      if (globalMode) {
-        numfacs -= badivs;     //subtract number of bad intervals from total
-        numfacs = max((int64_t)1, numfacs); //bugfix: sometimes there are more bad ivs than factors!
-        effectiveW -= numbad;  //we ignore the N-blocks
-      }
-
-      double cObs = (double)numfacs / effectiveW;
-      y[j] = max(0., (cObs  - cMin) / cNorm); //need max for corner case of no matches inside window
-
-      if (args.p) {
-        cout << "observed match factors: " << numfacs << endl;
-        cout << "observed match factors per nucleotide: " << cObs << endl;
-        cout << "mlComplexity = avgPerNucl / estimated = "
-              << cObs << "/" << cNorm << " = " << y[j] << endl;
-      }
-    }
+    cout  << "expected match factor length: " << norm.esl-1 << endl;
+    cout << "expected match factors per nucleotide: " << norm.cNorm << endl;
+  }
+
+  auto kernel = globalMode ? (args.p ? windowKernel<true, true, T> : windowKernel<true, false, T>)
+                           : (args.p ? windowKernel<false, true, T> : windowKernel<false, false, T>);
+  // windows are independent, printing factor counts needs their order
+  unsigned threads = args.p ? 1 : args.threads;
+  parallelFor(numEntries(n - shift, w, k), threads, [&](unsigned, size_t from, size_t to) {
+    kernel(q, from, to, y.data());
+  });
 }
 
-ResultMat calcComplexities(size_t &w, size_t &k, Task task, ComplexityData const &dat) {
-  bool globalMode = w==0;   // output one number (window = whole sequence)?
-  bool wholeSeq = task.idx < 0;
+template <typename T>
+void calcRegionStats(ComplexityData<T> &dat, vector<double> const &gc) {
+  dat.regionStats.clear();
+  for (size_t j = 0; j < dat.regions.size(); j++) {
+    size_t offset = dat.regions[j].first, len = dat.regions[j].second;
+    RegionStats st;
+    auto bad = numBad(offset, len, dat);
+    st.numbad = bad.first;
+    st.badivs = bad.second;
+    st.facts = len ? 1 + dat.factBits.rank(offset + len) - dat.factBits.rank(offset + 1) : 0;
+    st.gc = j < gc.size() ? gc[j] : nan("");
+    dat.regionStats.push_back(st);
+  }
+}
 
+template <typename T>
+pair<size_t, size_t> taskInterval(Task const &task, ComplexityData<T> const &dat) {
   size_t offset = 0;
   size_t len = dat.len;
-  if (!wholeSeq) {
+  if (task.idx >= 0) {
     offset = dat.regions[task.idx].first;
     len    = dat.regions[task.idx].second;
   }
@@ -172,25 +275,76 @@ ResultMat calcComplexities(size_t &w, size_t &k, Task task, ComplexityData const
     offset += task.start;
     len = task.end - task.start + 1;
   }
+  return make_pair(offset, len);
+}
+
+template <typename T>
+ResultMat calcComplexities(vector<size_t> &ws, size_t &k, Task task, ComplexityData<T> const &dat) {
+  bool globalMode = ws.empty(); // output one number (window = whole sequence)?
+  bool wholeSeq = task.idx < 0;
 
-  // adapt window size and interval
-  if (globalMode)
-    w = k = len;
-  w = min(w, len); // biggest window = whole seq.
-  if (w != 0 && k == 0)
-    k = max((size_t)1, w / 10); // default interval = 1/10 of window
-  k = min(k, w);                // biggest interval = window size
+  auto iv = taskInterval(task, dat);
+  size_t offset = iv.first;
+  size_t len = iv.second;
+
+  // adapt window sizes and interval
+  if (globalMode) {
+    ws.assign(1, len);
+    k = len;
+  }
+  for (auto &w : ws)
+    w = min(w, len); // biggest window = whole seq.
+  size_t wmin = *min_element(ws.begin(), ws.end());
+  size_t wmax = *max_element(ws.begin(), ws.end());
+  if (wmin != 0 && k == 0)
+    k = max((size_t)1, wmin / 10); // default interval = 1/10 of window
+  k = min(k, wmin);                // biggest interval = window size
 
   // cerr << offset << " " << len << " " << w << " " << k << endl;
 
-  // array for results for all sequences in file
-  size_t entries = numEntries(len, w, k);
-  ResultMat ys(1, make_pair("", vector<double>(entries)));
+  // one column per window size, the windows of a row have the same center
+  size_t entries = numEntries(len, wmax, k);
   string name = wholeSeq ? dat.name :  dat.labels[task.idx];
-  ys[0].first = name + " (MC)";
-
+  ResultMat ys;
+  MlNorm norm = mlNorm(dat);
   tick();
-  mlComplexity(offset, len, w, k, ys[0].second, dat);
+  for (auto w : ws) {
+    size_t shift = wmax / 2 - w / 2; // start of first window
+    ys.push_back(make_pair(name + " (MC)", vector<double>(numEntries(len - shift, w, k))));
+    if (ws.size() > 1)
+      ys.back().first = name + " (MC w=" + to_string(w) + ")";
+    mlComplexity(offset, len, w, k, ys.back().second, dat, norm, cerr, shift);
+    ys.back().second.resize(entries);
+  }
   tock("mlComplexity");
   return ys;
 }
+
+template <typename T>
+ResultMat calcComplexities(size_t &w, size_t &k, Task task, ComplexityData<T> const &dat) {
+  vector<size_t> ws(w ? 1 : 0, w);
+  ResultMat ys = calcComplexities(ws, k, task, dat);
+  w = ws[0];
+  return ys;
+}
+
+template void calcRegionStats(ComplexityData<uint32_t> &dat, vector<double> const &gc);
+template void calcRegionStats(ComplexityData<uint64_t> &dat, vector<double> const &gc);
+template pair<size_t, size_t> taskInterval(Task const &task, ComplexityData<uint32_t> const &dat);
+template pair<size_t, size_t> taskInterval(Task const &task, ComplexityData<uint64_t> const &dat);
+template MlNorm mlNorm(ComplexityData<uint32_t> const &dat);
+template MlNorm mlNorm(ComplexityData<uint64_t> const &dat);
+template void mlComplexity(size_t offset, size_t n, size_t w, size_t k, vector<double> &y,
+                           ComplexityData<uint32_t> const &dat, MlNorm const &norm, ostream &log,
+                           size_t shift);
+template void mlComplexity(size_t offset, size_t n, size_t w, size_t k, vector<double> &y,
+                           ComplexityData<uint64_t> const &dat, MlNorm const &norm, ostream &log,
+                           size_t shift);
+template ResultMat calcComplexities(vector<size_t> &ws, size_t &k, Task task,
+                                    ComplexityData<uint32_t> const &dat);
+template ResultMat calcComplexities(vector<size_t> &ws, size_t &k, Task task,
+                                    ComplexityData<uint64_t> const &dat);
+template ResultMat calcComplexities(size_t &w, size_t &k, Task task,
+                                    ComplexityData<uint32_t> const &dat);
+template ResultMat calcComplexities(size_t &w, size_t &k, Task task,
+                                    ComplexityData<uint64_t> const &dat);
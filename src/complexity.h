@@ -1,6 +1,6 @@
 #pragma once
+#include <iostream>
 #include <vector>
-#include <list>
 #include <utility>
 
 #include "args.h"
@@ -8,10 +8,39 @@
 
 size_t numEntries(size_t n, size_t w, size_t k);
 
-void mlComplexity(size_t offset, size_t n, size_t w, size_t k, std::vector<double> &y, ComplexityData const &dat);
+// fill dat.regionStats, gc contents of the regions are taken from gc (if not empty)
+template <typename T>
+void calcRegionStats(ComplexityData<T> &dat, std::vector<double> const &gc);
+
+// normalization of the complexity, it only depends on the whole sequence
+struct MlNorm {
+  double esl;   // expected shustring length
+  double cMin;  // minimal match factors per nucleotide
+  double cNorm; // expected (minus minimal) match factors per nucleotide
+};
+
+template <typename T> MlNorm mlNorm(ComplexityData<T> const &dat);
+
+// y[j] = max(0, (y[j] / w - cMin) / cNorm) for the factor counts y[j] of m
+// windows, negative entries (ignored windows) are kept. Without simd the
+// scalar loop is used even if the CPU has AVX2.
+void scaleCounts(double *y, size_t m, double w, double cMin, double cNorm, bool simd = true);
+
+// complexities of the windows of width w with step k in [offset, offset+n)
+// into y (numEntries(n - shift, w, k) entries), warnings are written to log.
+// The first window starts shift positions after offset, which stays the
+// start of the sequence or region.
+template <typename T>
+void mlComplexity(size_t offset, size_t n, size_t w, size_t k, std::vector<double> &y,
+                  ComplexityData<T> const &dat, MlNorm const &norm, std::ostream &log = std::cerr,
+                  size_t shift = 0);
 
 typedef std::vector<std::pair<std::string,std::vector<double>>> ResultMat;
 
+// interval (offset, length) of the sequence a valid task refers to
+template <typename T>
+std::pair<size_t, size_t> taskInterval(Task const &task, ComplexityData<T> const &dat);
+
 // This complicated function calculates the complexity data depending on mode.
 // The input data can be "joined" -> one single sequence with "regions", or all
 // sequences in the input are separate.
@@ -19,4 +48,11 @@ typedef std::vector<std::pair<std::string,std::vector<double>>> ResultMat;
 // and the user can choose a region or sequence to process.
 // If NOT joined: no chosen seqnum -> compute for all separately, otherwise only given sequence
 // If joined: no chosen seqnum -> compute for complete sequence, otherwise only one region
-ResultMat calcComplexities(size_t &w, size_t &k, Task task, ComplexityData const &dat);
+// With several window sizes ws (and interval k) the result has one column
+// per size, the windows in a row have the same center. w, ws and k are
+// adapted to the values used.
+template <typename T>
+ResultMat calcComplexities(std::vector<size_t> &ws, size_t &k, Task task,
+                           ComplexityData<T> const &dat);
+template <typename T>
+ResultMat calcComplexities(size_t &w, size_t &k, Task task, ComplexityData<T> const &dat);
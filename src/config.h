@@ -14,10 +14,40 @@
 #define VECBIT 0
 #endif
 typedef sdsl::int_vector<VECBIT> uint_vec;
-#else
-#ifndef U64
-typedef std::vector<uint32_t> uint_vec;
+const size_t UINT_VEC_MAX = SIZE_MAX;
+#elif defined(PACKED40)
+#include "packedvec.h"
+typedef Packed40Vec uint_vec;
+const size_t UINT_VEC_MAX = Packed40Vec::MAX;
 #else
 typedef std::vector<uint64_t> uint_vec;
+const size_t UINT_VEC_MAX = SIZE_MAX;
+#endif
+
+// array type for an index type: 32 bit indices are stored in plain vectors,
+// 64 bit indices in uint_vec (which may be bit-compressed)
+template <typename T> struct IdxVec { typedef std::vector<T> type; };
+template <> struct IdxVec<uint64_t> { typedef uint_vec type; };
+template <typename T> using idx_vec = typename IdxVec<T>::type;
+
+// reduce array to minimal bit width (only does something for SDSL vectors)
+template <typename V> inline void bitCompress(V &) {}
+#ifdef USE_SDSL
+template <> inline void bitCompress<uint_vec>(uint_vec &v) { sdsl::util::bit_compress(v); }
 #endif
+
+// can distinct entries of V be written from several threads at once?
+template <typename V> struct ConcurrentWrites { static const bool value = true; };
+#ifdef USE_SDSL
+// neighbouring entries share words
+template <> struct ConcurrentWrites<uint_vec> { static const bool value = false; };
 #endif
+// number of threads that may write into V
+template <typename V> inline unsigned writeThreads(unsigned threads) {
+  return ConcurrentWrites<V>::value ? threads : 1;
+}
+
+// true if all indices into a text of length n (and n itself) fit into 32 bits
+inline bool fitsIdx32(size_t n) { return n <= UINT32_MAX; }
+// true if all indices into a text of length n (and n itself) fit into uint_vec
+inline bool fitsIdx64(size_t n) { return n <= UINT_VEC_MAX; }
@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "mappedvec.h"
+
+// Non-decreasing sequence of integers, compressed as varint coded gaps in
+// blocks of BLOCK values. The first value of every block and the byte offset
+// of every block are stored uncompressed, so a value is found by decoding at
+// most one block. Serialized as n, number of blocks, number of bytes (64 bit
+// each), then the first values, the block offsets and the coded gaps.
+class DeltaVec {
+public:
+  static const size_t BLOCK = 64;
+
+  DeltaVec() {}
+  // encode values v[0..size) (which have to be non-decreasing)
+  template <typename V> explicit DeltaVec(V const &v) : n(v.size()) {
+    std::vector<uint64_t> fst, off;
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < n; i++) {
+      if (i % BLOCK == 0) {
+        fst.push_back(v[i]);
+        off.push_back(bytes.size());
+        continue;
+      }
+      uint64_t gap = (uint64_t)v[i] - (uint64_t)v[i - 1];
+      while (gap >= 0x80) {
+        bytes.push_back((uint8_t)(gap | 0x80));
+        gap >>= 7;
+      }
+      bytes.push_back((uint8_t)gap);
+    }
+    off.push_back(bytes.size());
+    firsts = MappedVec<uint64_t>(std::move(fst));
+    offsets = MappedVec<uint64_t>(std::move(off));
+    dat = MappedVec<uint8_t>(std::move(bytes));
+  }
+
+  size_t size() const { return n; }
+  size_t numBlocks() const { return firsts.size(); }
+
+  uint64_t operator[](size_t i) const {
+    uint64_t x = 0;
+    decode(i, i + 1, [&](size_t, uint64_t y) { x = y; });
+    return x;
+  }
+
+  // index of the first value >= x (size() if there is none)
+  size_t lowerBound(uint64_t x) const {
+    // first block starting with a value >= x, the answer is in the block before
+    size_t b = std::lower_bound(firsts.begin(), firsts.end(), x) - firsts.begin();
+    if (b == 0)
+      return 0;
+    size_t ret = std::min(n, b * BLOCK);
+    decode((b - 1) * BLOCK, ret, [&](size_t j, uint64_t y) {
+      if (y >= x && j < ret)
+        ret = j;
+    });
+    return ret;
+  }
+
+  // call f(i, value) for all i in [from, to) in increasing order
+  template <typename F> void decode(size_t from, size_t to, F f) const {
+    to = std::min(to, n);
+    if (from >= to)
+      return;
+    size_t b = from / BLOCK;
+    size_t i = b * BLOCK;
+    uint8_t const *p = dat.data() + offsets[b];
+    uint64_t x = firsts[b];
+    while (true) {
+      if (i >= from)
+        f(i, x);
+      if (++i >= to)
+        return;
+      if (i % BLOCK == 0) {
+        x = firsts[i / BLOCK];
+        p = dat.data() + offsets[i / BLOCK];
+        continue;
+      }
+      uint64_t gap = 0;
+      for (unsigned s = 0;; s += 7) {
+        uint8_t c = *p++;
+        gap |= (uint64_t)(c & 0x7f) << s;
+        if (c < 0x80)
+          break;
+      }
+      x += gap;
+    }
+  }
+
+  // number of bytes written by write()
+  size_t bytes() const { return 8 * (3 + firsts.size() + offsets.size()) + dat.size(); }
+
+  void write(std::ostream &o) const {
+    uint64_t head[3] = {n, firsts.size(), dat.size()};
+    o.write(reinterpret_cast<char const *>(head), sizeof(head));
+    o.write(reinterpret_cast<char const *>(firsts.data()), 8 * firsts.size());
+    o.write(reinterpret_cast<char const *>(offsets.data()), 8 * offsets.size());
+    o.write(reinterpret_cast<char const *>(dat.data()), dat.size());
+  }
+
+  // use a serialized DeltaVec of at most sz bytes at p (8 byte aligned)
+  // while owner is alive, returns false if it does not fit into sz bytes
+  static bool borrow(char const *p, size_t sz, std::shared_ptr<void const> owner, DeltaVec &v) {
+    uint64_t head[3];
+    if (sz < sizeof(head))
+      return false;
+    memcpy(head, p, sizeof(head));
+    size_t nb = head[1], nbytes = head[2];
+    if (nb > sz / 8 || nb != (head[0] + BLOCK - 1) / BLOCK ||
+        8 * (3 + 2 * nb + 1) > sz || nbytes > sz - 8 * (3 + 2 * nb + 1))
+      return false;
+    uint64_t const *w = reinterpret_cast<uint64_t const *>(p) + 3;
+    v.n = head[0];
+    v.firsts = MappedVec<uint64_t>::borrow(w, nb, owner);
+    v.offsets = MappedVec<uint64_t>::borrow(w + nb, nb + 1, owner);
+    v.dat = MappedVec<uint8_t>::borrow(reinterpret_cast<uint8_t const *>(w + 2 * nb + 1),
+                                       nbytes, owner);
+    return v.offsets[nb] == nbytes;
+  }
+
+private:
+  size_t n = 0;
+  MappedVec<uint64_t> firsts;  // first value of each block
+  MappedVec<uint64_t> offsets; // byte offset of each block (and the end)
+  MappedVec<uint8_t> dat;      // varint coded gaps
+};
@@ -10,12 +10,13 @@
  * Date: Mon Jul 15 11:11:19 2013
  **************************************************/
 #include <cinttypes>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
-#include <thread>
 using namespace std;
 
 #ifndef PARALLEL
+#include <divsufsort.h>
 #include <divsufsort64.h>
 #else
 #include <omp.h>
@@ -24,106 +25,264 @@ using namespace std;
 
 #include "bench.h"
 #include "esa.h"
+#include "parallel.h"
 
-// calculate suffix array using divsufsort
-uint_vec getSa(char const *seq, size_t n) {
-  sauchar_t *t = (sauchar_t *)seq;
+// sort suffixes with 64 bit divsufsort into a malloc'd array of n+1 entries
+static int64_t *sortSuffixes64(sauchar_t const *t, size_t n, unsigned threads) {
+  int64_t *sa = (int64_t *)calloc(n + 1, sizeof(int64_t));
+  if (!sa)
+    return nullptr;
 #ifndef PARALLEL
-  vector<saidx64_t> sa(n + 1);
-  if (divsufsort64(t, sa.data(), (saidx64_t)n) != 0) {
+  (void)threads; // libdivsufsort is sequential
+  int ret = divsufsort64(t, (saidx64_t *)sa, (saidx64_t)n);
 #else
-  vector<int64_t> sa(n + 1);
-  unsigned cores = std::thread::hardware_concurrency();
-  #pragma omp parallel
-  {
-    #pragma omp single
-    {
-      unsigned nthreads = omp_get_num_threads();
-      if (nthreads > cores) {
-        omp_set_num_threads(cores);
-        nthreads = cores;
-      }
-      cerr << "#cores: " << cores << "\t#threads: " << nthreads << endl;
-
-    }
-  }
-  if (divsufsort(t, sa.data(), (int64_t)n) != 0) {
+  omp_set_num_threads(threads);
+  int ret = divsufsort(t, sa, (int64_t)n);
 #endif
-    cout << "ERROR[esa]: suffix sorting failed." << endl;
-    exit(-1);
+  if (ret != 0) {
+    free(sa);
+    return nullptr;
   }
-  uint_vec ret(n+1);
+  return sa;
+}
+
+// sort suffixes with 64 bit divsufsort and copy the result
+template <typename V>
+static bool sortSuffixes(sauchar_t const *t, V &ret, size_t n, unsigned threads) {
+  int64_t *sa = sortSuffixes64(t, n, threads);
+  if (!sa)
+    return false;
+  ret = V(n + 1);
   for (size_t i=0; i<n+1; i++)
     ret[i] = sa[i];
-#ifdef USE_SDSL
-    sdsl::util::bit_compress(ret);
+  free(sa);
+  return true;
+}
+
+#ifdef PACKED40
+// 40 bit indices: divsufsort's result is packed in place
+static bool sortSuffixes(sauchar_t const *t, Packed40Vec &ret, size_t n, unsigned threads) {
+  int64_t *sa = sortSuffixes64(t, n, threads);
+  if (!sa)
+    return false;
+  ret.adopt(sa, n + 1);
+  return true;
+}
+#endif
+
+#ifndef PARALLEL
+// 32 bit indices: 32 bit divsufsort writes directly into the result
+static bool sortSuffixes(sauchar_t const *t, vector<uint32_t> &ret, size_t n, unsigned threads) {
+  if (n > (size_t)INT32_MAX) // too long for saidx_t
+    return sortSuffixes<vector<uint32_t>>(t, ret, n, threads);
+  ret.resize(n + 1);
+  return divsufsort(t, reinterpret_cast<saidx_t *>(ret.data()), (saidx_t)n) == 0;
+}
 #endif
+
+// calculate suffix array using divsufsort
+template <typename T> idx_vec<T> getSa(char const *seq, size_t n, unsigned threads) {
+  sauchar_t const *t = (sauchar_t const *)seq;
+  idx_vec<T> ret;
+  if (!sortSuffixes(t, ret, n, threads)) {
+    cout << "ERROR[esa]: suffix sorting failed." << endl;
+    exit(-1);
+  }
+  bitCompress(ret);
   return ret;
 }
 
+// values of the chunks of a parallel LCP computation that do not fit into a byte
+typedef vector<vector<pair<size_t, uint64_t>>> LargeLcps;
+
+// write the large values collected by the chunks into lcp
+static void mergeLarge(ByteLcp &lcp, LargeLcps const &large) {
+  for (auto &l : large)
+    for (auto &e : l)
+      lcp.set(e.first, e.second);
+  lcp.finalize();
+}
+
 /* calcLcp: compute LCP array using the algorithm in Figure 3
  *   of Kasai et al (2001). Linear-time longest-common-prefix
  *   computation in suffix arrays and its applications. LNCS 2089
  *   p. 191-192.
+ *   With several threads the text is split into chunks, each chunk
+ *   starts again with h = 0.
  */
-void calcLcp(Esa &esa) {
+template <typename T> void calcLcp(Esa<T> &esa, unsigned threads) {
   char const *t = esa.str;
   size_t n = esa.n;
-  auto &sa = esa.sa;
-  auto &rank = esa.isa;
+  auto const &sa = esa.sa;
+  auto const &rank = esa.isa;
 
   esa.lcp.resize(n + 1);
   auto &lcp = esa.lcp;
-  int64_t h = 0, j = 0;
   lcp[0] = lcp[n] = 0;
-  for (size_t i = 0; i < n; i++) {
-    if (rank[i] > 0) {
-      j = sa[rank[i] - 1];
+  LargeLcps large(numChunks(n, threads));
+  parallelFor(n, threads, [&](unsigned c, size_t from, size_t to) {
+    int64_t h = 0, j = 0;
+    for (size_t i = from; i < to; i++) {
+      if (rank[i] > 0) {
+        j = sa[rank[i] - 1];
+        while (t[i + h] == t[j + h])
+          h++;
+        if (!lcp.setSmall(rank[i], h))
+          large[c].push_back(make_pair((size_t)rank[i], (uint64_t)h));
+        if (h > 0)
+          h--;
+      }
+    }
+  });
+  mergeLarge(lcp, large);
+}
+
+/* calcPlcp: turn the Phi array (phi[sa[i]] = sa[i-1], phi[sa[0]] = n)
+ *   in place into the permuted LCP array, plcp[sa[i]] = lcp[i]. See
+ *   Kaerkkaeinen, Manzini and Puglisi (2009). Permuted longest-common-prefix
+ *   array. CPM 2009, LNCS 5577 p. 181-192.
+ *   Entry i is only read and written at position i, so text chunks can
+ *   be processed in parallel.
+ */
+template <typename V> void calcPlcp(V &phi, char const *t, size_t n, unsigned threads) {
+  parallelFor(n, writeThreads<V>(threads), [&](unsigned, size_t from, size_t to) {
+    size_t h = 0;
+    for (size_t i = from; i < to; i++) {
+      size_t j = phi[i];
+      if (j == n) { // no lexicographic predecessor
+        phi[i] = h = 0;
+        continue;
+      }
       while (t[i + h] == t[j + h])
         h++;
-      lcp[rank[i]] = h;
+      phi[i] = h;
       if (h > 0)
         h--;
     }
-  }
-#ifdef USE_SDSL
-  sdsl::util::bit_compress(lcp);
+  });
+}
+
+/* calcLcpPhi: compute LCP array without an inverse suffix array by the
+ *   sparse Phi algorithm of Kaerkkaeinen, Manzini and Puglisi (2009): Phi
+ *   and PLCP are only kept for every PHI_SAMPLE-th text position. As
+ *   plcp[i] >= plcp[i-s] - s, every LCP value is then extended from the
+ *   PLCP value of the sample before its suffix. Besides the suffix array
+ *   and the LCP array this needs n/PHI_SAMPLE entries.
+ */
+static const size_t PHI_SAMPLE = 8;
+static const size_t PHI_PREFETCH = 32; // suffixes between prefetch and use
+
+// length of the common prefix of the suffixes a and b of t[0..n), which is
+// at least h, compared 8 characters at a time away from the end
+static size_t extendLcp(char const *t, size_t n, size_t a, size_t b, size_t h) {
+  for (size_t e = max(a, b) + 8; e + h <= n; h += 8) {
+    uint64_t x, y;
+    memcpy(&x, t + a + h, 8);
+    memcpy(&y, t + b + h, 8);
+    if (x != y) // the first character is the lowest byte on little endian
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      return h + __builtin_clzll(x ^ y) / 8;
+#else
+      return h + __builtin_ctzll(x ^ y) / 8;
 #endif
+  }
+  while (t[a + h] == t[b + h])
+    h++;
+  return h;
+}
+
+template <typename T> void calcLcpPhi(Esa<T> &esa, unsigned threads) {
+  size_t n = esa.n, q = PHI_SAMPLE;
+  auto const &sa = esa.sa;
+  char const *t = esa.str;
+
+  // Phi of the sampled positions, then turned into their PLCP values
+  vector<T> plcp((n + q - 1) / q);
+  parallelFor(n, threads, [&](unsigned, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+      if (sa[i] % q == 0)
+        plcp[sa[i] / q] = i ? (size_t)sa[i - 1] : n;
+  });
+  parallelFor(plcp.size(), threads, [&](unsigned, size_t from, size_t to) {
+    size_t h = 0;
+    for (size_t k = from; k < to; k++) {
+      size_t i = k * q, j = plcp[k];
+      if (j == n) { // no lexicographic predecessor
+        plcp[k] = h = 0;
+        continue;
+      }
+      h = extendLcp(t, n, i, j, h);
+      plcp[k] = h;
+      h = h > q ? h - q : 0;
+    }
+  });
+
+  esa.lcp.resize(n + 1);
+  auto &lcp = esa.lcp;
+  lcp[0] = lcp[n] = 0;
+  LargeLcps large(numChunks(n, threads));
+  parallelFor(n, threads, [&](unsigned c, size_t from, size_t to) {
+    for (size_t i = max((size_t)1, from); i < to; i++) {
+      if (i + PHI_PREFETCH < to) { // text and sample of a later suffix
+        size_t d = sa[i + PHI_PREFETCH];
+        __builtin_prefetch(t + d);
+        __builtin_prefetch(&plcp[d / q]);
+      }
+      size_t p = sa[i], j = sa[i - 1], s = p % q, h = plcp[p / q];
+      h = extendLcp(t, n, p, j, h > s ? h - s : 0);
+      if (!lcp.setSmall(i, h))
+        large[c].push_back(make_pair(i, (uint64_t)h));
+    }
+  });
+  mergeLarge(lcp, large);
 }
 
-Esa::Esa(char const *seq, size_t len) : str(seq), n(len) {
+template <typename T>
+Esa<T>::Esa(char const *seq, size_t len, LcpAlgo algo, unsigned threads) : str(seq), n(len) {
   // string s(str);
   // construct_im(sa, s.c_str(), 1);
   tick();
-  sa = getSa(seq, n);
+  sa = getSa<T>(seq, n, threads);
   tock("libdivsufsort");
 
-  isa = uint_vec(n+1);
-  for (size_t i = 0; i < n; i++)
-    isa[sa[i]] = i;
-#ifdef USE_SDSL
-  sdsl::util::bit_compress(isa);
-#endif
+  if (algo == LcpAlgo::Phi) {
+    tick();
+    calcLcpPhi(*this, threads);
+    tock("calcLcpPhi");
+    return;
+  }
+
+  isa = idx_vec<T>(n+1);
+  parallelFor(n, writeThreads<idx_vec<T>>(threads), [&](unsigned, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+      isa[sa[i]] = i;
+  });
+  bitCompress(isa);
 
   tick();
-  calcLcp(*this);
+  calcLcp(*this, threads);
   tock("calcLCP");
 }
 
-void Esa::print() const {
+template <typename T> void Esa<T>::print() const {
   cout << "i\tSA\tISA\tLCP\tSuffix" << endl;
-  for (size_t i = 0; i < this->n; i++)
-    cout << i << "\t" << sa[i] << "\t" << isa[i] << "\t" << lcp[i] << "\t" << str + sa[i]
-         << endl;
+  for (size_t i = 0; i < this->n; i++) {
+    cout << i << "\t" << sa[i] << "\t";
+    if (isa.size() > i)
+      cout << isa[i];
+    else
+      cout << "-";
+    cout << "\t" << lcp[i] << "\t" << str + sa[i] << endl;
+  }
 }
 
 // reduce esa to half (seq+$+revseq+$ -> seq+$) without recomputing
 // important! asserting that n and str are replaced by user!
-void reduceEsa(Esa &esa) {
+template <typename T> void reduceEsa(Esa<T> &esa) {
   size_t n = esa.sa.size() / 2;
-  uint_vec sa(n);
-  uint_vec isa(n);
-  uint_vec lcp(n + 1);
+  idx_vec<T> sa(n);
+  idx_vec<T> isa(n);
+  ByteLcp lcp(n + 1);
   lcp[0] = lcp[n] = 0;
   sa[0] = n - 1;
   isa[n - 1] = 0;
@@ -143,12 +302,19 @@ void reduceEsa(Esa &esa) {
   esa.sa.resize(0);
   esa.isa.resize(0);
   esa.lcp.resize(0);
-#ifdef USE_SDSL
-  sdsl::util::bit_compress(sa);
-  sdsl::util::bit_compress(isa);
-  sdsl::util::bit_compress(lcp);
-#endif
+  bitCompress(sa);
+  bitCompress(isa);
+  lcp.finalize();
   esa.sa = sa;
   esa.isa = isa;
   esa.lcp = lcp;
 }
+
+template class Esa<uint32_t>;
+template class Esa<uint64_t>;
+template idx_vec<uint32_t> getSa<uint32_t>(char const *seq, size_t n, unsigned threads);
+template idx_vec<uint64_t> getSa<uint64_t>(char const *seq, size_t n, unsigned threads);
+template void calcPlcp(idx_vec<uint32_t> &phi, char const *t, size_t n, unsigned threads);
+template void calcPlcp(idx_vec<uint64_t> &phi, char const *t, size_t n, unsigned threads);
+template void reduceEsa(Esa<uint32_t> &esa);
+template void reduceEsa(Esa<uint64_t> &esa);
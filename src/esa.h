@@ -6,24 +6,34 @@
  * Date: Mon Jul 15 11:17:08 2013
  **************************************************/
 #pragma once
+#include "bytelcp.h"
 #include "config.h"
 #ifndef PARALLEL
+#include <divsufsort.h>
 #include <divsufsort64.h>
 #else
 #include <divsufsort.h>
 #endif
 
-/* define data container */
-class Esa {
+/* algorithm used to fill the LCP array */
+enum class LcpAlgo {
+  Kasai, /* Kasai et al., needs (and keeps) the inverse suffix array */
+  Phi    /* permuted LCP via a sparse Phi array, isa stays empty */
+};
+
+/* define data container, T is the index type (uint32_t or uint64_t) */
+template <typename T = uint64_t> class Esa {
 public:
-  Esa(char const *seq, size_t n);
+  Esa(char const *seq, size_t n, LcpAlgo algo = LcpAlgo::Kasai, unsigned threads = 1);
   void print() const;
 
-  uint_vec sa;    /* suffix array */
-  uint_vec isa;   /* inverse suffix array */
-  uint_vec lcp;   /* longest common prefix array */
+  idx_vec<T> sa;    /* suffix array */
+  idx_vec<T> isa;   /* inverse suffix array (empty for LcpAlgo::Phi) */
+  ByteLcp lcp;      /* longest common prefix array */
   char const *str;            /* pointer to underlying string */
   size_t n;                   /* length of sa and lcp */
 };
 
-void reduceEsa(Esa &esa);
+template <typename T> idx_vec<T> getSa(char const *seq, size_t n, unsigned threads = 1);
+template <typename V> void calcPlcp(V &phi, char const *t, size_t n, unsigned threads = 1);
+template <typename T> void reduceEsa(Esa<T> &esa);
@@ -0,0 +1,693 @@
+/***** extsa.cpp **********************************
+ * Description: Semi-external suffix array construction.
+ *   The text stays in memory, suffix and LCP array are
+ *   written to scratch files. In one pass over the text the
+ *   suffixes are distributed to scratch files by their first
+ *   k characters, so that each file fits into the memory
+ *   budget; a prefix with more suffixes is split again by
+ *   the next k characters. In memory the suffixes are put
+ *   into buckets by prefix and each bucket is sorted by LCP
+ *   merge sort (Ng and Kakehi 2008), which gives the LCP
+ *   array and never compares a common prefix twice. Long
+ *   runs of one character are skipped in comparisons, and
+ *   the suffixes starting in them are not sorted but placed
+ *   by the length of the run, so N blocks do not degrade
+ *   the sort.
+ **************************************************/
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "extsa.h"
+#include "parallel.h"
+#include "util.h"
+
+const size_t MAX_BUCKETS = 1 << 20; // bucket counters for suffix prefixes
+const size_t MIN_RUN = 32;          // runs of one char skipped in comparisons
+const size_t MAX_FILES = 256;       // scratch files written at once
+const size_t MIN_IOBUF = 1 << 12;   // stdio buffer size of scratch files
+const size_t MAX_IOBUF = 1 << 20;
+
+// how the memory budget is split: half of it for the suffixes sorted in
+// memory (with LCP and merge buffer 32 bytes each) or for the buffers of
+// the scratch files written at once, the bucket counters take less than
+// a third of it
+struct Budget {
+  explicit Budget(size_t mem) {
+    entries = max((size_t)2, mem / 64);
+    keys = max((size_t)2, min(MAX_BUCKETS, mem / 64));
+    iobuf = max(MIN_IOBUF, min(MAX_IOBUF, mem / 64));
+    files = max((size_t)2, min(MAX_FILES, mem / 2 / iobuf));
+  }
+  size_t entries; // suffixes sorted in memory at once
+  size_t keys;    // number of bucket counters
+  size_t iobuf;   // buffer size of a scratch file
+  size_t files;   // scratch files written at once
+};
+
+// scratch file of 64 bit values, read or write errors are reported by close()
+class ScratchFile {
+public:
+  ScratchFile() {}
+  ScratchFile(ScratchFile const &) = delete;
+  ScratchFile &operator=(ScratchFile const &) = delete;
+  ~ScratchFile() {
+    if (f)
+      fclose(f);
+  }
+
+  bool open(string const &file, char const *mode, size_t buf) {
+    name = file;
+    f = fopen(file.c_str(), mode);
+    if (!f) {
+      cerr << "ERROR: Could not open scratch file " << file << ": " << strerror(errno) << endl;
+      return false;
+    }
+    setvbuf(f, nullptr, _IOFBF, buf);
+    ok = true;
+    return true;
+  }
+
+  void put(uint64_t x) { ok = ok && fwrite(&x, sizeof(x), 1, f) == 1; }
+  uint64_t get() {
+    uint64_t x = 0;
+    ok = ok && fread(&x, sizeof(x), 1, f) == 1;
+    return x;
+  }
+
+  bool close() {
+    bool closed = f && fclose(f) == 0;
+    f = nullptr;
+    if (ok && closed)
+      return true;
+    cerr << "ERROR: Could not read or write scratch file " << name << "!" << endl;
+    return false;
+  }
+
+private:
+  FILE *f = nullptr;
+  string name;
+  bool ok = false;
+};
+
+// text with long runs of equal characters for fast suffix comparisons
+class RunText {
+public:
+  RunText(char const *str, size_t len) : t(str), n(len) {
+    size_t i = 0;
+    while (i < n) {
+      size_t j = i + 1;
+      while (j < n && t[j] == t[i])
+        j++;
+      if (j - i >= MIN_RUN)
+        runs.push_back(make_pair(i, j));
+      i = j;
+    }
+  }
+
+  // character at p, -1 past the end of the text
+  int at(size_t p) const { return p < n ? (int)(uint8_t)t[p] : -1; }
+
+  // length of the common prefix of suffixes a and b, known to be >= l
+  size_t lcp(size_t a, size_t b, size_t l) const {
+    size_t lim = n - max(a, b);
+    while (l < lim) {
+      size_t end = min(lim, l + MIN_RUN);
+      while (l < end && t[a + l] == t[b + l])
+        l++;
+      if (l < end)
+        break;
+      size_t ra = runLeft(a + l), rb = runLeft(b + l);
+      if (ra && rb && t[a + l] == t[b + l])
+        l += min(ra, rb);
+    }
+    return min(l, lim);
+  }
+
+  // is suffix a smaller than suffix b, which share l characters
+  bool less(size_t a, size_t b, size_t l) const { return at(a + l) < at(b + l); }
+
+  size_t size() const { return n; }
+  // [start, end) of the runs of at least MIN_RUN equal characters
+  vector<pair<size_t, size_t>> const &longRuns() const { return runs; }
+
+private:
+  // number of chars left in the long run containing p (0 if none)
+  size_t runLeft(size_t p) const {
+    auto it = upper_bound(runs.begin(), runs.end(), make_pair(p, SIZE_MAX));
+    if (it == runs.begin())
+      return 0;
+    --it;
+    return p < it->second ? it->second - p : 0;
+  }
+
+  char const *t;
+  size_t n;
+  vector<pair<size_t, size_t>> runs; // [start, end) of long runs
+};
+
+// key of k characters of the suffixes, characters mapped to their rank in
+// the alphabet (0 = end of text)
+class PrefixKey {
+public:
+  PrefixKey(char const *str, size_t len, size_t maxKeys) : t((uint8_t const *)str), n(len) {
+    bool present[256] = {false};
+    for (size_t i = 0; i < n; i++)
+      present[t[i]] = true;
+    size_t sigma = 0;
+    for (size_t c = 0; c < 256; c++)
+      rank[c] = present[c] ? ++sigma : 0;
+    base = sigma + 1;
+    k = 1;
+    pw = 1;
+    while (pw * base * base <= maxKeys) {
+      pw *= base;
+      k++;
+    }
+    buckets = pw * base;
+  }
+
+  // call f(i, key) for all suffixes in text order, key of the first k characters
+  template <typename F> void each(F f) const {
+    size_t key = 0;
+    for (size_t j = 0; j < k; j++)
+      key = key * base + chr(j);
+    for (size_t i = 0; i < n; i++) {
+      f(i, key);
+      key = (key % pw) * base + chr(i + k);
+    }
+  }
+
+  // key of the k characters of suffix p after its first d characters
+  size_t at(size_t p, size_t d) const {
+    size_t key = 0;
+    for (size_t j = 0; j < k; j++)
+      key = key * base + chr(p + d + j);
+    return key;
+  }
+
+  size_t k;       // prefix length
+  size_t buckets; // number of keys
+
+private:
+  size_t chr(size_t p) const { return p < n ? rank[t[p]] : 0; }
+
+  uint8_t const *t;
+  size_t n;
+  size_t rank[256];
+  size_t base; // alphabet size + 1
+  size_t pw;   // base^(k-1)
+};
+
+// The suffixes starting with at least MIN_RUN copies of a character c. A
+// suffix in the long run [s, e) of c that is followed by x is c^r x... with
+// r = e - p, so first come the runs followed by x < c by increasing r, then
+// the ones followed by x > c by decreasing r, equal r in the order of the
+// suffixes at the ends of the runs.
+class RunBlock {
+public:
+  RunBlock(RunText const &txt, int chr, vector<pair<size_t, size_t>> const &runs) : c(chr) {
+    for (auto &r : runs)
+      rs.push_back(Run{r.second, r.second - r.first, txt.at(r.second) > c});
+    sort(rs.begin(), rs.end(), [&](Run const &a, Run const &b) {
+      if (a.upper != b.upper)
+        return b.upper;
+      return txt.less(a.end, b.end, txt.lcp(a.end, b.end, 0));
+    });
+    // sparse table of the minimal LCP of neighbouring run ends
+    mins.push_back(vector<size_t>(rs.size()));
+    for (size_t i = 0; i + 1 < rs.size(); i++)
+      mins[0][i] = txt.lcp(rs[i].end, rs[i + 1].end, 0);
+    for (size_t w = 2; w < rs.size(); w *= 2) {
+      auto const &m = mins.back();
+      vector<size_t> next(rs.size() - w);
+      for (size_t i = 0; i + w < rs.size(); i++)
+        next[i] = min(m[i], m[i + w / 2]);
+      mins.push_back(move(next));
+    }
+  }
+
+  // call f(p, lcp) for the suffixes in order, lcp is the LCP with the
+  // previous one (0 for the first)
+  template <typename F> void each(F f) const {
+    size_t prev = SIZE_MAX, prevR = 0;
+    auto emit = [&](size_t i, size_t r) {
+      size_t lcp = 0;
+      if (prev != SIZE_MAX)
+        lcp = prevR == r && rs[prev].upper == rs[i].upper ? r + minLcp(prev, i) : min(prevR, r);
+      f(rs[i].end - r, lcp);
+      prev = i;
+      prevR = r;
+    };
+    vector<size_t> act; // runs with suffixes of the current r, in order
+    for (size_t i = 0; i < rs.size() && !rs[i].upper; i++)
+      act.push_back(i);
+    for (size_t r = MIN_RUN; !act.empty(); r++) {
+      act.erase(remove_if(act.begin(), act.end(), [&](size_t i) { return rs[i].len < r; }),
+                act.end());
+      for (size_t i : act)
+        emit(i, r);
+    }
+    vector<size_t> byLen; // upper runs by decreasing length
+    for (size_t i = 0; i < rs.size(); i++)
+      if (rs[i].upper)
+        byLen.push_back(i);
+    sort(byLen.begin(), byLen.end(), [&](size_t a, size_t b) { return rs[a].len > rs[b].len; });
+    size_t next = 0;
+    for (size_t r = byLen.empty() ? 0 : rs[byLen[0]].len; r >= MIN_RUN; r--) {
+      size_t added = act.size();
+      while (next < byLen.size() && rs[byLen[next]].len == r)
+        act.push_back(byLen[next++]);
+      sort(act.begin() + added, act.end());
+      inplace_merge(act.begin(), act.begin() + added, act.end());
+      for (size_t i : act)
+        emit(i, r);
+    }
+  }
+
+  int c;
+
+private:
+  struct Run {
+    size_t end, len;
+    bool upper; // followed by a greater character
+  };
+  vector<Run> rs;              // lower runs, then upper runs, by suffix at the end
+  vector<vector<size_t>> mins; // mins[l][i]: minimal LCP of rs[i..i+2^l]
+
+  // minimal LCP of neighbouring run ends in rs[a..b], a < b
+  size_t minLcp(size_t a, size_t b) const {
+    size_t l = 0;
+    while ((size_t)2 << l <= b - a)
+      l++;
+    return min(mins[l][a], mins[l][b - ((size_t)1 << l)]);
+  }
+};
+
+// writes suffix and LCP array, the suffixes of the run blocks are put
+// before the first greater suffix
+class SaWriter {
+public:
+  SaWriter(RunText const &text, vector<RunBlock> const &runBlocks)
+      : txt(text), blocks(runBlocks) {}
+
+  bool open(ExtSa const &ext, size_t iobuf) {
+    return saf.open(ext.saFile, "wb", iobuf) && lcpf.open(ext.lcpFile, "wb", iobuf);
+  }
+
+  // write suffix p, its LCP with the previous suffix is h if exact, or at least h
+  void put(size_t p, size_t h, bool exact) {
+    while (next < blocks.size() && greater(p, blocks[next].c)) {
+      flush(blocks[next++]);
+      h = 0;
+      exact = false;
+    }
+    write(p, exact || prev == SIZE_MAX ? h : txt.lcp(prev, p, h));
+  }
+
+  bool close() {
+    while (next < blocks.size())
+      flush(blocks[next++]);
+    bool ok = saf.close();
+    return lcpf.close() && ok;
+  }
+
+private:
+  void write(size_t p, size_t lcp) {
+    saf.put(p);
+    lcpf.put(lcp);
+    prev = p;
+  }
+
+  void flush(RunBlock const &b) {
+    bool first = true;
+    b.each([&](size_t p, size_t lcp) {
+      write(p, first && prev != SIZE_MAX ? txt.lcp(prev, p, 0) : lcp);
+      first = false;
+    });
+  }
+
+  // is suffix p, which is in no run block, greater than the suffixes
+  // starting with MIN_RUN copies of c
+  bool greater(size_t p, int c) const {
+    size_t r = 0;
+    while (txt.at(p + r) == c)
+      r++;
+    return txt.at(p + r) > c;
+  }
+
+  RunText const &txt;
+  vector<RunBlock> const &blocks;
+  size_t next = 0;       // next run block to write
+  size_t prev = SIZE_MAX; // last suffix written
+  ScratchFile saf, lcpf;
+};
+
+// sorts the suffixes outside the run blocks within the memory budget
+class BlockSorter {
+public:
+  BlockSorter(RunText const &text, PrefixKey const &key, Budget const &budget,
+              string const &scratch, SaWriter &writer, unsigned threads)
+      : txt(text), pk(key), b(budget), dir(scratch), out(writer), nthreads(threads) {}
+
+  // sort the cnt suffixes listed in file (all outside the run blocks if
+  // file is empty), which share their first d characters, the first one
+  // shares at least lb characters with the suffix written before. The
+  // file is removed.
+  bool sort(string const &file, size_t cnt, size_t d, size_t lb) {
+    if (cnt <= b.entries)
+      return sortInMemory(file, cnt, d, lb);
+
+    // parts of keys that fit into memory, a key with more suffixes is a
+    // part of its own that is split by the next k characters
+    vector<Group> parts;
+    vector<uint32_t> groupOf(pk.buckets);
+    while (true) {
+      vector<size_t> keyCnt(pk.buckets);
+      if (!each(file, cnt, d, [&](size_t, size_t key) { keyCnt[key]++; }))
+        return false;
+      for (size_t key = 0; key < pk.buckets; key++) {
+        if (!keyCnt[key])
+          continue;
+        bool big = keyCnt[key] > b.entries;
+        if (parts.empty() || big || parts.back().deeper ||
+            parts.back().cnt + keyCnt[key] > b.entries)
+          parts.push_back(Group{0, big, 0});
+        parts.back().cnt += keyCnt[key];
+        parts.back().parts = 1;
+        groupOf[key] = parts.size() - 1;
+      }
+      if (parts.size() > 1)
+        break;
+      parts.clear(); // all suffixes share k more characters
+      d += pk.k;
+    }
+    // with too many parts for the open files consecutive parts share a
+    // file, which is split again
+    vector<Group> groups = parts;
+    if (parts.size() > b.files) {
+      groups.clear();
+      vector<uint32_t> partGroup(parts.size());
+      for (size_t j = 0, sum = 0; j < parts.size(); j++) {
+        if (groups.empty() || sum + parts[j].cnt > (cnt + b.files - 1) / b.files) {
+          groups.push_back(Group{0, false, 0});
+          sum = 0;
+        }
+        groups.back().cnt += parts[j].cnt;
+        groups.back().deeper = ++groups.back().parts == 1 && parts[j].deeper;
+        sum += parts[j].cnt;
+        partGroup[j] = groups.size() - 1;
+      }
+      for (auto &g : groupOf)
+        g = partGroup[g];
+    }
+    vector<Group>().swap(parts);
+
+    // distribute the suffixes to the files of the groups
+    vector<string> names(groups.size());
+    {
+      vector<ScratchFile> files(groups.size());
+      for (size_t g = 0; g < groups.size(); g++) {
+        names[g] = dir + "/part." + to_string(nextFile++);
+        if (!files[g].open(names[g], "wb", b.iobuf))
+          return false;
+      }
+      if (!each(file, cnt, d, [&](size_t p, size_t key) { files[groupOf[key]].put(p); }))
+        return false;
+      for (auto &f : files)
+        if (!f.close())
+          return false;
+    }
+    if (!file.empty())
+      remove(file.c_str());
+    vector<uint32_t>().swap(groupOf);
+    for (size_t g = 0; g < groups.size(); g++)
+      if (!sort(names[g], groups[g].cnt, groups[g].deeper ? d + pk.k : d, g ? d : lb))
+        return false;
+    return true;
+  }
+
+private:
+  // suffixes of consecutive keys that go into one file
+  struct Group {
+    size_t cnt;
+    bool deeper; // one key with too many suffixes, split by the next characters
+    size_t parts;
+  };
+
+  typedef pair<size_t, size_t> Entry; // LCP (or key), suffix
+
+  // call f(p, key) for the cnt suffixes p in file (or the suffixes outside
+  // the run blocks), key of the k characters after the first d, the file
+  // is removed afterwards
+  template <typename F> bool each(string const &file, size_t cnt, size_t d, F f) const {
+    if (file.empty()) {
+      auto const &runs = txt.longRuns();
+      size_t run = 0;
+      auto g = [&](size_t p, size_t key) {
+        while (run < runs.size() && runs[run].second - MIN_RUN < p)
+          run++;
+        if (run == runs.size() || p < runs[run].first)
+          f(p, key);
+      };
+      if (d == 0)
+        pk.each(g);
+      else
+        for (size_t p = 0; p < txt.size(); p++)
+          g(p, pk.at(p, d));
+      return true;
+    }
+    ScratchFile in;
+    if (!in.open(file, "rb", b.iobuf))
+      return false;
+    for (size_t i = 0; i < cnt; i++) {
+      size_t p = in.get();
+      f(p, pk.at(p, d));
+    }
+    return in.close();
+  }
+
+  bool sortInMemory(string const &file, size_t cnt, size_t d, size_t lb) {
+    // suffixes with their keys are counted and placed by key
+    vector<Entry> block(cnt), tmp(cnt);
+    size_t j = 0;
+    if (!each(file, cnt, d, [&](size_t p, size_t key) { tmp[j++] = make_pair(key, p); }))
+      return false;
+    if (!file.empty())
+      remove(file.c_str());
+    vector<size_t> pos(pk.buckets + 1);
+    for (auto &e : tmp)
+      pos[e.first + 1]++;
+    for (size_t key = 0; key < pk.buckets; key++)
+      pos[key + 1] += pos[key];
+    {
+      vector<size_t> fill(pos.begin(), pos.end() - 1);
+      for (auto &e : tmp)
+        block[fill[e.first]++] = make_pair((size_t)0, e.second);
+    }
+    parallelFor(pk.buckets, nthreads, [&](unsigned, size_t from, size_t to) {
+      for (size_t key = from; key < to; key++)
+        lcpMergeSort(&block[pos[key]], &tmp[pos[key]], pos[key + 1] - pos[key], d + pk.k);
+    });
+    for (size_t key = 0; key < pk.buckets; key++)
+      for (size_t i = pos[key]; i < pos[key + 1]; i++) {
+        if (i > pos[key])
+          out.put(block[i].second, block[i].first, true);
+        else
+          out.put(block[i].second, i ? d : lb, false);
+      }
+    return true;
+  }
+
+  // sort the m suffixes a[i].second, which share their first d characters,
+  // with the merge buffer tmp. Afterwards a[i].first is the LCP of a[i]
+  // and a[i-1] (d for i = 0).
+  void lcpMergeSort(Entry *a, Entry *tmp, size_t m, size_t d) const {
+    if (m <= 1) {
+      if (m)
+        a[0].first = d;
+      return;
+    }
+    size_t h = m / 2;
+    lcpMergeSort(a, tmp, h, d);
+    lcpMergeSort(a + h, tmp + h, m - h, d);
+    // x[i].first is the LCP of x[i] with the last suffix written to tmp
+    Entry *x = a, *xe = a + h, *y = a + h, *ye = a + m, *o = tmp;
+    while (x < xe && y < ye) {
+      if (x->first > y->first) {
+        *o++ = *x++;
+      } else if (x->first < y->first) {
+        *o++ = *y++;
+      } else {
+        size_t l = txt.lcp(x->second, y->second, x->first);
+        if (txt.less(x->second, y->second, l)) {
+          y->first = l;
+          *o++ = *x++;
+        } else {
+          x->first = l;
+          *o++ = *y++;
+        }
+      }
+    }
+    o = copy(x, xe, o);
+    copy(y, ye, o);
+    copy(tmp, tmp + m, a);
+  }
+
+  RunText const &txt;
+  PrefixKey const &pk;
+  Budget const &b;
+  string dir;
+  SaWriter &out;
+  unsigned nthreads;
+  size_t nextFile = 0;
+};
+
+// compute the suffix array and LCP array of str with about mem bytes of
+// memory (besides the text) and store them in files below tmpdir
+bool buildExtSa(ExtSa &ext, char const *str, size_t n, size_t mem, string const &tmpdir,
+                unsigned threads) {
+  string tmpl = tmpdir + "/macle.XXXXXX";
+  vector<char> dirbuf(tmpl.begin(), tmpl.end());
+  dirbuf.push_back('\0');
+  if (!mkdtemp(dirbuf.data())) {
+    cerr << "ERROR: Could not create scratch directory in " << tmpdir << endl;
+    return false;
+  }
+  ext.dir = dirbuf.data();
+  ext.saFile = ext.dir + "/sa";
+  ext.lcpFile = ext.dir + "/lcp";
+  ext.n = n;
+
+  Budget b(mem);
+  RunText txt(str, n);
+  PrefixKey pk(str, n, b.keys);
+
+  // suffixes in long runs are placed by run length
+  vector<vector<pair<size_t, size_t>>> runsOf(256);
+  size_t inRuns = 0;
+  for (auto &r : txt.longRuns()) {
+    runsOf[txt.at(r.first)].push_back(r);
+    inRuns += r.second - r.first - MIN_RUN + 1;
+  }
+  vector<RunBlock> blocks;
+  for (int c = 0; c < 256; c++)
+    if (!runsOf[c].empty())
+      blocks.push_back(RunBlock(txt, c, runsOf[c]));
+
+  tick();
+  SaWriter out(txt, blocks);
+  BlockSorter sorter(txt, pk, b, ext.dir, out, threads);
+  bool ok = out.open(ext, b.iobuf) && sorter.sort("", n - inRuns, 0, 0) && out.close();
+  tock("sort suffixes");
+  return ok;
+}
+
+// remove the scratch directory with all files in it
+void removeExtSa(ExtSa &ext) {
+  if (!ext.dir.empty()) {
+    if (DIR *d = opendir(ext.dir.c_str())) {
+      while (dirent *e = readdir(d))
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, ".."))
+          remove((ext.dir + "/" + e->d_name).c_str());
+      closedir(d);
+    }
+    rmdir(ext.dir.c_str());
+  }
+  ext.dir = ext.saFile = ext.lcpFile = "";
+}
+
+// input: scratch files of seq$revcompseq$.
+// The match lengths max(lcp[i], lcp[i+1]) of first strand suffixes are
+// streamed from the scratch files into one file per text range (as many
+// ranges per pass as files can be written at once), the ranges are then
+// loaded one after another to walk the factors.
+template <typename T>
+bool computeMLFactExt(Fact<T> &mlf, ExtSa const &ext, char const *str, size_t mem) {
+  mlf.fact.resize(0);
+  mlf.str = str;
+  mlf.strLen = ext.n/2; //single strand length
+
+  // the match lengths of a range take half of mem, the file buffers the rest
+  Budget b(mem);
+  size_t range = max((size_t)1, mem / 2 / sizeof(uint64_t));
+  size_t nranges = (mlf.strLen + range - 1) / range;
+
+  vector<size_t> factmp;
+  vector<uint64_t> ml(min(range, mlf.strLen));
+  size_t i = 0;
+  for (size_t r0 = 0; r0 < nranges; r0 += b.files) {
+    size_t r1 = min(nranges, r0 + b.files);
+
+    /* distribute match lengths to text ranges [r0, r1) */
+    {
+      vector<ScratchFile> mlfs(r1 - r0);
+      for (size_t r = r0; r < r1; r++)
+        if (!mlfs[r - r0].open(ext.dir + "/ml." + to_string(r), "wb", b.iobuf))
+          return false;
+      ScratchFile saf, lcpf;
+      if (!saf.open(ext.saFile, "rb", b.iobuf) || !lcpf.open(ext.lcpFile, "rb", b.iobuf))
+        return false;
+      uint64_t lcp = lcpf.get(); // lcp[0]
+      for (size_t j = 0; j < ext.n; j++) {
+        uint64_t p = saf.get();
+        uint64_t lcpNext = j + 1 < ext.n ? lcpf.get() : 0;
+        if (p < mlf.strLen && p / range >= r0 && p / range < r1) {
+          mlfs[p / range - r0].put(p);
+          mlfs[p / range - r0].put(max((uint64_t)1, max(lcp, lcpNext)));
+        }
+        lcp = lcpNext;
+      }
+      bool ok = saf.close();
+      ok = lcpf.close() && ok;
+      for (auto &f : mlfs)
+        ok = f.close() && ok;
+      if (!ok)
+        return false;
+    }
+
+    /* compute observed number of match factors, store their positions */
+    for (size_t r = r0; r < r1; r++) {
+      size_t from = r * range;
+      size_t to = min(mlf.strLen, from + range);
+      string file = ext.dir + "/ml." + to_string(r);
+      ScratchFile f;
+      if (!f.open(file, "rb", b.iobuf))
+        return false;
+      for (size_t j = from; j < to; j++) {
+        uint64_t p = f.get(), x = f.get();
+        if (p - from < to - from)
+          ml[p - from] = x;
+      }
+      if (!f.close())
+        return false;
+      remove(file.c_str());
+
+      while (i < to) {
+        factmp.push_back(i);
+        i += ml[i - from];
+      }
+    }
+  }
+
+  mlf.fact.resize(factmp.size());
+  for (i=0; i<factmp.size(); i++)
+    mlf.fact[i] = factmp[i];
+  bitCompress(mlf.fact);
+  return true;
+}
+
+template bool computeMLFactExt(Fact<uint32_t> &mlf, ExtSa const &ext, char const *str,
+                               size_t mem);
+template bool computeMLFactExt(Fact<uint64_t> &mlf, ExtSa const &ext, char const *str,
+                               size_t mem);
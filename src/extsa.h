@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+
+#include "matchlength.h"
+
+// suffix array and LCP array of a text, stored in scratch files
+// (one little endian uint64_t per entry, LCP[i] is the LCP of SA[i-1] and SA[i])
+struct ExtSa {
+  std::string dir;     // scratch directory
+  std::string saFile;  // suffix array
+  std::string lcpFile; // LCP array
+  size_t n;            // length of text
+};
+
+// false on errors (reported on stderr), removeExtSa cleans up in any case
+bool buildExtSa(ExtSa &ext, char const *str, size_t n, size_t mem, std::string const &tmpdir,
+                unsigned threads = 1);
+void removeExtSa(ExtSa &ext);
+
+template <typename T>
+bool computeMLFactExt(Fact<T> &mlf, ExtSa const &ext, char const *str, size_t mem);
@@ -1,4 +1,5 @@
 #include "fastafile.h"
+#include "gzip.h"
 #include "util.h"
 
 #include <err.h>
@@ -7,7 +8,14 @@
 //for open_or_fail flags
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <vector>
@@ -20,47 +28,403 @@ FastaSeq::FastaSeq(string const &n, string const &c, string const &s)
 
 FastaFile::FastaFile() : failed(false) {}
 
-// input: filename of fasta file (or 0 for STDIN), reference to an empty number
-// output: either successfully parsed file, or NULL
-FastaFile::FastaFile(char const *file) : failed(false) {
-  seqs = vector<FastaSeq>();
-
-  // open file
-  int fd = file ? open_or_fail(file, O_RDONLY) : STDIN_FILENO;
-  filename = file ? base_name(string(file)) : "<stdin>";
-  if (fd < 0)
-    err(1, "%s", file);
-
-  // init parser
+// read with the pfasta parser from a stream, returns an error message
+static string readStream(FastaFile &ff, int fd, bool concat) {
+  string msg;
   int l;
   pfasta_file pf;
   if ((l = pfasta_parse(&pf, fd)) != 0) {
-    warnx("%s: %s", filename.c_str(), pfasta_strerror(&pf));
+    msg = pfasta_strerror(&pf);
     pfasta_free(&pf);
-    failed = true;
-    return;
+    return msg;
   }
 
+  pfasta_buf buf = {nullptr, 0, 1 << 20};
+  if (concat && !(buf.str = (char *)malloc(buf.cap)))
+    err(1, "%s", ff.filename.c_str());
+
   // read sequences
   pfasta_seq seq;
-  while ((l = pfasta_read(&pf, &seq)) == 0) {
-    seqs.push_back(FastaSeq());
-    auto &fseq = seqs.back();
+  while ((l = concat ? pfasta_read_into(&pf, &seq, &buf) : pfasta_read(&pf, &seq)) == 0) {
+    ff.seqs.push_back(FastaSeq());
+    auto &fseq = ff.seqs.back();
     fseq.name = seq.name ? string(seq.name) : "";
     fseq.comment = seq.comment ? string(seq.comment) : "";
-    fseq.seq = seq.seq ? string(seq.seq) : "";
-    for (char &c : fseq.seq)
-      c = toupper(c); // acgt->ACGT
+    if (concat)
+      ff.regions.push_back(make_pair(buf.len - seq.len, seq.len));
+    else {
+      fseq.seq = seq.seq ? string(seq.seq) : "";
+      for (char &c : fseq.seq)
+        c = toupper(c); // acgt->ACGT
+    }
     pfasta_seq_free(&seq);
   }
 
   if (l < 0) {
-    warnx("%s: %s", filename.c_str(), pfasta_strerror(&pf));
+    msg = pfasta_strerror(&pf);
     pfasta_seq_free(&seq);
-    failed = true;
   }
 
+  if (concat && msg.empty()) {
+    // room for the reverse complement
+    char *neu = (char *)realloc(buf.str, 2 * buf.len + 3);
+    if (!neu)
+      err(1, "%s", ff.filename.c_str());
+    ff.text = shared_ptr<char>(neu, free);
+    ff.len = buf.len;
+  } else
+    free(buf.str);
+
   pfasta_free(&pf);
+  return msg;
+}
+
+// copy the sequence line s[0..n) in upper case to d, returns the index of the
+// first character that is not printable (n if there is none). The blocks are
+// processed without branches, so the compiler can vectorize them. d may lie
+// before s in the same buffer, a block is only written once it is checked.
+static size_t copyUpper(char const *s, size_t n, char *d) {
+  size_t const B = 32;
+  size_t i = 0;
+  for (; i + B <= n; i += B) {
+    unsigned bad = 0;
+    for (size_t j = 0; j < B; j++)
+      bad |= (unsigned char)(s[i + j] - 0x21) > 0x5d; // !isgraph(c)
+    if (bad)
+      break;
+    for (size_t j = 0; j < B; j++) {
+      unsigned char c = s[i + j];
+      d[i + j] = c - ((unsigned char)(c - 'a') < 26) * 32; // toupper(c)
+    }
+  }
+  for (; i < n; i++) {
+    unsigned char c = s[i];
+    if ((unsigned char)(c - 0x21) > 0x5d)
+      return i;
+    d[i] = c - ((unsigned char)(c - 'a') < 26) * 32;
+  }
+  return n;
+}
+
+// read the file contents p[0..n) (mapped or decompressed) with the same rules
+// and messages as pfasta: lines are found with memchr and copied in blocks.
+// With own, p was allocated with malloc and has room for 2n+3 characters; the
+// text is then compacted in place (it never gets ahead of the parser) and ff
+// takes over the buffer.
+static string readMapped(FastaFile &ff, char *own, char const *p, size_t n, bool concat) {
+  size_t i = 0, line = 1;
+  char ebuf[PF_ERROR_STRING_LENGTH];
+#define FAIL_STR(...)                                                                    \
+  do {                                                                                   \
+    snprintf(ebuf, PF_ERROR_STRING_LENGTH, __VA_ARGS__);                                 \
+    return ebuf;                                                                         \
+  } while (0)
+
+  // sequences are not longer than the file, so the buffer does not grow (its
+  // untouched end costs no memory)
+  char *text = own;
+  size_t len = 0;
+  if (concat && !text && !(text = (char *)malloc(2 * n + 3)))
+    err(1, "%s", ff.filename.c_str());
+  if (concat || own)
+    ff.text = shared_ptr<char>(text, free);
+
+  if (n == 0)
+    FAIL_STR("Empty file");
+  if (p[0] != '>')
+    FAIL_STR("File does not start with '>'");
+
+  while (i < n) {
+    if (p[i] != '>')
+      FAIL_STR("Expected '>', but found '%c' on line %zu", p[i], line);
+    // name: printable characters after '>'
+    size_t s = ++i;
+    while (i < n && isgraph(p[i]))
+      i++;
+    if (i == n)
+      FAIL_STR("Unexpected EOF in sequence name on line %zu", line);
+    if (i == s)
+      FAIL_STR("Empty name on line %zu", line);
+    ff.seqs.push_back(FastaSeq());
+    FastaSeq &fseq = ff.seqs.back();
+    fseq.name.assign(p + s, i - s);
+    if (isblank(p[i])) { // comment: rest of the line after the blank
+      s = ++i;
+      char const *e = (char const *)memchr(p + i, '\n', n - i);
+      if (!e)
+        FAIL_STR("Unexpected EOF in sequence comment on line %zu", line);
+      i = e - p;
+      fseq.comment.assign(p + s, i - s);
+    }
+
+    // sequence: lines up to an empty line, a line starting with '>' or EOF,
+    // starting after the character that ended the header
+    size_t start = len;
+    while (true) {
+      if (p[i++] == '\n')
+        line++;
+      if (i == n || p[i] == '>' || p[i] == '\n')
+        break;
+      char const *e = (char const *)memchr(p + i, '\n', n - i);
+      size_t end = e ? e - p : n;
+      if (!concat)
+        fseq.seq.resize(len + end - i);
+      size_t ok = copyUpper(p + i, end - i, concat ? text + len : &fseq.seq[len - start]);
+      if (ok < end - i)
+        FAIL_STR("Unexpected character '%c' in sequence on line %zu", p[i + ok], line);
+      len += end - i;
+      i = end;
+      if (i == n)
+        break;
+    }
+    if (len == start)
+      FAIL_STR("Empty sequence on line %zu", line);
+    if (concat)
+      ff.regions.push_back(make_pair(start, len - start));
+    else
+      len = 0;
+
+    // skip blank lines
+    while (i < n && p[i] == '\n') {
+      line++;
+      i++;
+    }
+  }
+#undef FAIL_STR
+  ff.len = concat ? len : 0;
+  if (!concat)
+    ff.text.reset();
+  return "";
+}
+
+/* .2bit files (UCSC): the signature TWOBIT_SIGNATURE in the byte order of
+ * the writer, the version (1 has 64 bit sequence offsets), the number of
+ * sequences and a reserved word, then the name and offset of each sequence.
+ * A sequence record has the length, the N-blocks and the mask blocks (all
+ * starts, then all sizes), a reserved word and the bases with 2 bits each
+ * (T, C, A, G), the first base in the highest bits. N-blocks are stored as
+ * T and overwritten, mask blocks (lower case) are ignored.
+ */
+const uint32_t TWOBIT_SIGNATURE = 0x1A412743;
+
+static bool isTwoBit(char const *p, size_t n) {
+  uint32_t sig;
+  if (n < sizeof(sig))
+    return false;
+  memcpy(&sig, p, sizeof(sig));
+  return sig == TWOBIT_SIGNATURE || __builtin_bswap32(sig) == TWOBIT_SIGNATURE;
+}
+
+// the 4 bases of every byte of packed .2bit data
+static char const *twoBitTable() {
+  static char tab[256 * 4];
+  static bool init = [] {
+    char const *b = "TCAG";
+    for (size_t x = 0; x < 256; x++)
+      for (size_t j = 0; j < 4; j++)
+        tab[4 * x + j] = b[(x >> (6 - 2 * j)) & 3];
+    return true;
+  }();
+  (void)init;
+  return tab;
+}
+
+// read a .2bit file, the N-blocks become the bad intervals of the text
+static string readTwoBit(FastaFile &ff, char const *p, size_t n, bool concat) {
+  uint32_t sig;
+  memcpy(&sig, p, sizeof(sig));
+  bool swap = sig != TWOBIT_SIGNATURE;
+  size_t pos = sizeof(sig);
+  auto get32 = [&](uint32_t &x) {
+    if (n - pos < 4)
+      return false;
+    memcpy(&x, p + pos, 4);
+    x = swap ? __builtin_bswap32(x) : x;
+    pos += 4;
+    return true;
+  };
+  auto get64 = [&](uint64_t &x) {
+    uint32_t lo, hi;
+    if (!get32(swap ? hi : lo) || !get32(swap ? lo : hi))
+      return false;
+    x = (uint64_t)hi << 32 | lo;
+    return true;
+  };
+  string const trunc = "Truncated .2bit file";
+
+  uint32_t version, count, reserved;
+  if (!get32(version) || !get32(count) || !get32(reserved))
+    return trunc;
+  if (version > 1)
+    return "Unsupported .2bit version " + to_string(version);
+  if (count == 0)
+    return "Empty file";
+  vector<uint64_t> offs(count);
+  for (size_t i = 0; i < count; i++) {
+    if (pos >= n || n - pos - 1 < (unsigned char)p[pos])
+      return trunc;
+    size_t nlen = (unsigned char)p[pos++];
+    ff.seqs.push_back(FastaSeq());
+    ff.seqs.back().name.assign(p + pos, nlen);
+    pos += nlen;
+    uint32_t off32;
+    if (version ? !get64(offs[i]) : !get32(off32))
+      return trunc;
+    if (!version)
+      offs[i] = off32;
+  }
+
+  // total length for the text buffer
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t dna;
+    pos = offs[i];
+    if (offs[i] > n || !get32(dna))
+      return trunc;
+    if (dna == 0)
+      return "Empty sequence " + ff.seqs[i].name;
+    total += dna;
+  }
+  char *text = (char *)malloc(2 * total + 3);
+  if (!text)
+    err(1, "%s", ff.filename.c_str());
+  ff.text = shared_ptr<char>(text, free);
+
+  char const *tab = twoBitTable();
+  size_t len = 0;
+  vector<pair<uint32_t, uint32_t>> nblocks;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t dna, nbc, mbc;
+    pos = offs[i];
+    get32(dna);
+    if (!get32(nbc) || (n - pos) / 8 < nbc)
+      return trunc;
+    nblocks.resize(nbc);
+    for (auto &b : nblocks)
+      get32(b.first);
+    for (auto &b : nblocks)
+      get32(b.second);
+    if (!get32(mbc) || (n - pos) / 8 < mbc)
+      return trunc;
+    pos += 8 * (size_t)mbc;
+    if (!get32(reserved) || n - pos < ((size_t)dna + 3) / 4)
+      return trunc;
+
+    unsigned char const *q = reinterpret_cast<unsigned char const *>(p + pos);
+    char *d = text + len;
+    for (size_t j = 0; j < dna / 4; j++)
+      memcpy(d + 4 * j, tab + 4 * q[j], 4);
+    if (dna % 4)
+      memcpy(d + dna / 4 * 4, tab + 4 * q[dna / 4], dna % 4);
+
+    sort(nblocks.begin(), nblocks.end());
+    for (auto &b : nblocks) {
+      if (b.first > dna || b.second > dna - b.first)
+        return "Invalid N-block in sequence " + ff.seqs[i].name;
+      if (b.second == 0)
+        continue;
+      memset(d + b.first, 'N', b.second);
+      size_t from = len + b.first, to = len + b.first + b.second - 1;
+      if (!ff.bad.empty() && from <= ff.bad.back().second + 1) // adjacent or overlapping
+        ff.bad.back().second = max(ff.bad.back().second, to);
+      else
+        ff.bad.push_back(make_pair(from, to));
+    }
+    ff.regions.push_back(make_pair(len, (size_t)dna));
+    len += dna;
+  }
+  ff.len = len;
+  ff.knownBad = true;
+
+  if (!concat) {
+    for (size_t i = 0; i < count; i++)
+      ff.seqs[i].seq.assign(text + ff.regions[i].first, ff.regions[i].second);
+    ff.text.reset();
+    ff.regions.clear();
+    ff.len = 0;
+  }
+  return "";
+}
+
+// input: filename of fasta file (or 0 for STDIN), reference to an empty number
+// output: either successfully parsed file, or NULL
+FastaFile::FastaFile(char const *file, bool concat, unsigned threads) : failed(false) {
+  seqs = vector<FastaSeq>();
+
+  // open file
+  int fd = file ? open_or_fail(file, O_RDONLY) : STDIN_FILENO;
+  filename = file ? base_name(string(file)) : "<stdin>";
+  if (fd < 0)
+    err(1, "%s", file);
+
+  // regular files are mapped, anything else is read by pfasta
+  struct stat st;
+  shared_ptr<MMapReader> m;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    m = map_fd(fd, filename.c_str());
+  string msg;
+  if (m && isGzip(m->dat, m->sz)) { // gzip or BGZF, decompressed in memory
+    char *raw;
+    size_t n;
+    msg = gunzip(m->dat, m->sz, raw, n, threads);
+    m.reset();
+    if (msg.empty() && isTwoBit(raw, n)) {
+      msg = readTwoBit(*this, raw, n, concat);
+      free(raw);
+    } else if (msg.empty()) { // the decompressed file becomes the text
+      char *neu = (char *)realloc(raw, 2 * n + 3);
+      if (!neu)
+        err(1, "%s", filename.c_str());
+      msg = readMapped(*this, neu, neu, n, concat);
+    }
+  } else if (m && isTwoBit(m->dat, m->sz))
+    msg = readTwoBit(*this, m->dat, m->sz, concat);
+  else if (m) {
+    madvise(const_cast<char *>(m->dat), m->sz, MADV_SEQUENTIAL);
+    msg = readMapped(*this, nullptr, m->dat, m->sz, concat);
+  } else
+    msg = readStream(*this, fd, concat);
+  if (!msg.empty()) {
+    warnx("%s: %s", filename.c_str(), msg.c_str());
+    failed = true;
+    error = msg;
+    text.reset();
+    bad.clear();
+  }
+
   if (file)
     close(fd);
 }
+
+void FastaFile::concat() {
+  if (text)
+    return;
+  len = 0;
+  for (auto &s : seqs)
+    len += s.seq.size();
+  text = shared_ptr<char>((char *)malloc(2 * len + 3), free);
+  if (!text)
+    err(1, "%s", filename.c_str());
+  regions.clear();
+  size_t offset = 0;
+  for (auto &s : seqs) {
+    regions.push_back(make_pair(offset, s.seq.size()));
+    memcpy(text.get() + offset, s.seq.data(), s.seq.size());
+    offset += s.seq.size();
+    s.seq = ""; //free memory of separate sequences
+  }
+}
+
+size_t estimateLength(char const *file) {
+  struct stat st;
+  if (stat(file, &st) != 0)
+    return 0;
+  char head[4] = {0, 0, 0, 0};
+  FILE *f = fopen(file, "rb");
+  if (!f)
+    return 0;
+  size_t got = fread(head, 1, sizeof(head), f);
+  fclose(f);
+  bool packed = isGzip(head, got) || isTwoBit(head, got);
+  return packed ? 4 * (size_t)st.st_size : (size_t)st.st_size;
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "pfasta.h"
 
+#include <memory>
+#include <utility>
 #include <vector>
 #include <string>
 
@@ -12,11 +14,32 @@ struct FastaSeq {
   std::string seq;
 };
 
-/* basic sequence type representing >= 1 entry in FASTA file */
+/* basic sequence type representing >= 1 entry in FASTA (or .2bit) file */
 struct FastaFile {
   FastaFile();
-  FastaFile(char const *file);
+  // parse file (stdin if null), with concat the sequences are only stored in
+  // text. Compressed files (gzip or BGZF) are decompressed with threads threads.
+  FastaFile(char const *file, bool concat = false, unsigned threads = 1);
   std::string filename; //filename
-  std::vector<FastaSeq> seqs; // the sequences
+  std::vector<FastaSeq> seqs; // the sequences (without seq if they are in text)
   bool failed;
+  std::string error; // why parsing failed
+
+  // all sequences one after another in upper case, the buffer has room for
+  // 2*len+3 characters (sequence, reverse complement and terminators)
+  std::shared_ptr<char> text;
+  size_t len = 0;
+  std::vector<std::pair<size_t, size_t>> regions; // offset and length of each sequence in text
+
+  // runs of N (start, end) in text if the file lists them (.2bit), then the
+  // text does not have to be scanned for them
+  std::vector<std::pair<size_t, size_t>> bad;
+  bool knownBad = false;
+
+  // move the sequences of seqs into text (if they are not there yet)
+  void concat();
 };
+
+// rough number of bases in a sequence file from its size (compressed and
+// .2bit files have about 4 bases per byte), 0 if it can not be read
+size_t estimateLength(char const *file);
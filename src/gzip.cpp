@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "gzip.h"
+#include "parallel.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+bool isGzip(char const *p, size_t n) {
+  return n >= 2 && (unsigned char)p[0] == 0x1f && (unsigned char)p[1] == 0x8b;
+}
+
+#ifdef USE_ZLIB
+
+static uint32_t le16(unsigned char const *q) { return q[0] | q[1] << 8; }
+static uint32_t le32(unsigned char const *q) { return le16(q) | le16(q + 2) << 16; }
+
+// a BGZF block: raw deflate data at in, its content at out of the result
+struct BgzfBlock {
+  size_t in, inLen, out, outLen;
+  uint32_t crc;
+};
+
+// split p[0..n) into BGZF blocks, false if it is not a BGZF file. Every
+// member has to have a header with only the extra field (like bgzip writes
+// it) and the "BC" subfield has the size of the member minus 1.
+static bool bgzfBlocks(char const *p, size_t n, vector<BgzfBlock> &bs) {
+  size_t off = 0, out = 0;
+  while (off < n) {
+    unsigned char const *q = reinterpret_cast<unsigned char const *>(p + off);
+    if (n - off < 12 || q[0] != 0x1f || q[1] != 0x8b || q[2] != 8 || q[3] != 4)
+      return false;
+    size_t xlen = le16(q + 10), bsize = 0;
+    if (n - off < 12 + xlen)
+      return false;
+    for (size_t x = 12; x + 4 <= 12 + xlen;) {
+      size_t slen = le16(q + x + 2);
+      if (q[x] == 'B' && q[x + 1] == 'C' && slen == 2 && x + 6 <= 12 + xlen)
+        bsize = le16(q + x + 4) + 1;
+      x += 4 + slen;
+    }
+    if (bsize < 12 + xlen + 8 || bsize > n - off)
+      return false;
+    BgzfBlock b;
+    b.in = off + 12 + xlen;
+    b.inLen = bsize - 12 - xlen - 8;
+    b.crc = le32(q + bsize - 8);
+    b.out = out;
+    b.outLen = le32(q + bsize - 4);
+    bs.push_back(b);
+    out += b.outLen;
+    off += bsize;
+  }
+  return true;
+}
+
+// decompress a block into its place in out, false if it is corrupt
+static bool inflateBlock(char const *p, BgzfBlock const &b, char *out) {
+  z_stream zs = {};
+  if (inflateInit2(&zs, -15) != Z_OK)
+    return false;
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(p + b.in));
+  zs.avail_in = b.inLen;
+  zs.next_out = reinterpret_cast<Bytef *>(out + b.out);
+  zs.avail_out = b.outLen;
+  bool ok = inflate(&zs, Z_FINISH) == Z_STREAM_END && zs.avail_out == 0;
+  inflateEnd(&zs);
+  return ok && crc32(0, reinterpret_cast<Bytef const *>(out + b.out), b.outLen) == b.crc;
+}
+
+static string gunzipBgzf(char const *p, vector<BgzfBlock> const &bs, char *&out, size_t &len,
+                         unsigned threads) {
+  len = bs.empty() ? 0 : bs.back().out + bs.back().outLen;
+  if (!(out = (char *)malloc(max(len, (size_t)1))))
+    return "Out of memory";
+  // the threads get parts of the output of about the same size
+  atomic<bool> ok(true);
+  auto byOut = [](BgzfBlock const &b, size_t x) { return b.out < x; };
+  parallelFor(len, threads, [&](unsigned, size_t from, size_t to) {
+    auto it = lower_bound(bs.begin(), bs.end(), from, byOut);
+    auto end = to == len ? bs.end() : lower_bound(bs.begin(), bs.end(), to, byOut);
+    for (; it != end && ok; ++it)
+      if (!inflateBlock(p, *it, out))
+        ok = false;
+  });
+  return ok ? "" : "Corrupt BGZF block";
+}
+
+// decompress (concatenated) gzip members one after another
+static string gunzipStream(char const *p, size_t n, char *&out, size_t &len) {
+  z_stream zs = {};
+  if (inflateInit2(&zs, 15 + 16) != Z_OK)
+    return "Could not initialize zlib";
+  // the size of the last member (modulo 2^32) is a good guess for one
+  // member, deflate does not compress more than about 1:1032
+  size_t cap = n >= 4 ? le32(reinterpret_cast<unsigned char const *>(p + n - 4)) : 0;
+  cap = max((size_t)1 << 20, min(cap + 1, 1032 * n));
+  size_t in = 0;
+  len = 0;
+  string msg;
+  if (!(out = (char *)malloc(cap)))
+    msg = "Out of memory";
+  while (msg.empty()) {
+    if (len == cap) {
+      char *neu = (char *)realloc(out, 2 * cap);
+      if (!neu) {
+        msg = "Out of memory";
+        break;
+      }
+      out = neu;
+      cap *= 2;
+    }
+    if (zs.avail_in == 0) {
+      zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(p + in));
+      zs.avail_in = min(n - in, (size_t)UINT_MAX);
+      in += zs.avail_in;
+    }
+    zs.next_out = reinterpret_cast<Bytef *>(out + len);
+    zs.avail_out = min(cap - len, (size_t)UINT_MAX);
+    size_t avail = zs.avail_out;
+    int r = inflate(&zs, Z_NO_FLUSH);
+    len += avail - zs.avail_out;
+    if (r == Z_STREAM_END) {
+      size_t rest = n - in + zs.avail_in; // next member (if any) starts here
+      if (rest == 0)
+        break;
+      if (!isGzip(p + n - rest, rest)) {
+        msg = "Trailing garbage after gzip data";
+        break;
+      }
+      inflateReset(&zs);
+    } else if (r != Z_OK && !(r == Z_BUF_ERROR && zs.avail_out == 0)) {
+      msg = r == Z_BUF_ERROR ? "Unexpected end of gzip data" : "Corrupt gzip data";
+      break;
+    } else if (r == Z_OK && zs.avail_in == 0 && in == n && zs.avail_out != 0) {
+      msg = "Unexpected end of gzip data";
+      break;
+    }
+  }
+  inflateEnd(&zs);
+  return msg;
+}
+
+string gunzip(char const *p, size_t n, char *&out, size_t &len, unsigned threads) {
+  vector<BgzfBlock> bs;
+  out = nullptr;
+  len = 0;
+  string msg = bgzfBlocks(p, n, bs) ? gunzipBgzf(p, bs, out, len, threads)
+                                    : gunzipStream(p, n, out, len);
+  if (!msg.empty()) {
+    free(out);
+    out = nullptr;
+  }
+  return msg;
+}
+
+#else
+
+string gunzip(char const *, size_t, char *&out, size_t &len, unsigned) {
+  out = nullptr;
+  len = 0;
+  return "Compressed input needs a build with zlib (USE_ZLIB=1)";
+}
+
+#endif
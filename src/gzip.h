@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// true if p[0..n) starts like a gzip (or BGZF) file
+bool isGzip(char const *p, size_t n);
+
+// decompress all gzip members in p[0..n) into out, a buffer of len bytes
+// allocated with malloc that the caller frees (null after an error). It is
+// not zero-filled and sized from the BGZF block sizes or the size field of
+// the last member, so it only grows for concatenated members. BGZF files
+// (gzip members with the block size in the "BC" extra field, as written by
+// bgzip) are decompressed block by block with the given number of threads.
+// Returns an error message, empty on success.
+std::string gunzip(char const *p, size_t n, char *&out, size_t &len, unsigned threads = 1);
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -10,8 +11,12 @@ using namespace std;
 #include "args.h"  //args.p
 #include "bench.h" //tick tock
 #include "matchlength.h" //computeMLFact
+#include "extsa.h" //buildExtSa, computeMLFactExt
+#include "complexity.h" //calcRegionStats
 
+#include "deltavec.h"
 #include "index.h"
+#include "parallel.h"
 #include "util.h"
 
 template<typename T> void binwrite(ostream &o, T x) {
@@ -20,154 +25,505 @@ template<typename T> void binwrite(ostream &o, T x) {
 template<typename T> void binread(istream &i, T &x) {
   i.read(reinterpret_cast<char*>(&x),sizeof(x));
 }
-/*
-template<typename T> void binget(MMapReader &i, size_t offbytes, T &x) {
-  x = *reinterpret_cast<T*>(i.dat+i.off+offbytes);
-}
-template<typename T> void binread(MMapReader &i, T &x) {
-  binget(i, 0, x);
-  i.off += sizeof(x);
+
+/* Index files, version 2: a fixed size header with an offset table,
+ * followed by the sections at 64 byte aligned offsets, all values are
+ * 64 bit little endian, except the match factors (factWidth bytes each).
+ * Arrays are used straight from a mapping of the file, so indexes are only
+ * written and read on little endian machines; a big endian one rejects the
+ * file by its byte order mark instead of swapping every value. With IDX_PACKED_BAD set in the flags, the bad intervals (as start,
+ * end, start, ...) are stored as DeltaVec, the count of the section is then
+ * the number of values. The factor starts are stored once: as RankBitVec,
+ * which is used from the mapping, or with IDX_PACKED_MLF as DeltaVec of the
+ * positions, from which the RankBitVec is built when loading. The other one
+ * and the first factor of each region are empty sections (older files have
+ * the raw factors or both). Then follows a RegionStats for each region.
+ * Sections added later are missing in files with a smaller number of
+ * sections. Version 1 ("BINIDX" followed by the
+ * fields one after another) can still be loaded.
+ */
+const string magicstr = "BINIDX";    // version 1
+const string magicstr2 = "MACLEIX2"; // version 2
+const uint64_t IDX_VERSION = 2;
+const uint64_t BYTE_ORDER_MARK = 0x0102030405060708ULL;
+const size_t IDX_ALIGN = 64;
+const uint64_t IDX_PACKED_MLF = 1;
+const uint64_t IDX_PACKED_BAD = 2;
+
+enum IdxSectionId { SEC_NAME, SEC_LABELS, SEC_REGIONS, SEC_BAD, SEC_FSTREGIONFACT, SEC_MLF,
+                    SEC_FACTBITS, SEC_REGIONSTATS, NUM_SECTIONS };
+const size_t MIN_SECTIONS = SEC_FACTBITS; // sections of the first version 2 files
+
+struct IdxSection {
+  uint64_t offset; // byte offset from start of file
+  uint64_t count;  // number of entries
+};
+
+struct IdxHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t byteorder;
+  uint64_t len;
+  double gc;
+  uint64_t numbad;
+  uint64_t factWidth; // bytes per match factor
+  uint64_t flags;     // IDX_PACKED_*
+  uint64_t numSections;
+  IdxSection sec[NUM_SECTIONS];
+};
+
+// label as stored in the index: length, then MAX_LABEL_LEN chars
+struct IdxLabel {
+  uint64_t len;
+  char str[MAX_LABEL_LEN];
+};
+
+typedef pair<size_t, size_t> Interval;
+static_assert(sizeof(size_t) == 8 && sizeof(Interval) == 16, "index needs 64 bit size_t");
+static_assert(sizeof(RegionStats) == 32, "unexpected padding in RegionStats");
+
+static size_t alignUp(size_t x) { return (x + IDX_ALIGN - 1) / IDX_ALIGN * IDX_ALIGN; }
+
+static IdxLabel toIdxLabel(string const &l) {
+  IdxLabel lbl;
+  memset(&lbl, 0, sizeof(lbl));
+  lbl.len = l.size();
+  memcpy(lbl.str, l.data(), min(l.size(), MAX_LABEL_LEN));
+  return lbl;
 }
-*/
 
-const string magicstr = "BINIDX";
+// flattened bad intervals (start, end, start, ...)
+struct BadValues {
+  MappedVec<Interval> const &bad;
+  size_t size() const { return 2 * bad.size(); }
+  size_t operator[](size_t i) const { return i % 2 ? bad[i / 2].second : bad[i / 2].first; }
+};
 
-bool saveData(ComplexityData &cd, char const *file) {
+template <typename T> bool saveData(ComplexityData<T> &cd, char const *file, bool compress) {
   assert(cd.regions.size() == cd.labels.size());
-  return with_file_out(file, [&](ostream &o) {
-    for (auto c : magicstr) //magic sequence
-      binwrite(o, c);
-
-    binwrite(o, (size_t)cd.name.size());
-    for (auto c : cd.name)
-      binwrite(o, c);
-    binwrite(o, cd.len);
-    binwrite(o, cd.gc);
-
-    binwrite(o, (size_t)cd.regions.size());
-    for (auto i : cd.regions){
-      binwrite(o, i.first);
-      binwrite(o, i.second);
-    }
-    for (auto &l : cd.labels) {
-      binwrite(o, l.size());
-      for (size_t i=0; i<MAX_LABEL_LEN; i++)
-        binwrite(o, i < l.size() ? l[i] : (char)0);
-    }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  cerr << "ERROR: Index files are little endian, they can not be written on this machine!" << endl;
+  return false;
+#endif
+  IdxHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, magicstr2.data(), sizeof(h.magic));
+  h.version = IDX_VERSION;
+  h.byteorder = BYTE_ORDER_MARK;
+  h.len = cd.len;
+  h.gc = cd.gc;
+  h.numbad = cd.numbad;
+  h.factWidth = sizeof(T);
+  h.flags = compress ? IDX_PACKED_MLF | IDX_PACKED_BAD : 0;
+  h.numSections = NUM_SECTIONS;
+
+  // number of entries, size and writer of each section
+  vector<IdxLabel> lbls;
+  for (auto &l : cd.labels)
+    lbls.push_back(toIdxLabel(l));
+  DeltaVec badPacked, mlfPacked;
+  if (compress) {
+    badPacked = DeltaVec(BadValues{cd.bad});
+    vector<uint64_t> facts;
+    cd.factBits.eachSet([&](size_t i) { facts.push_back(i); });
+    mlfPacked = DeltaVec(facts);
+  }
+  typedef function<void(ostream &)> Writer;
+  auto raw = [](void const *dat, size_t bytes) {
+    return Writer([=](ostream &o) { o.write(reinterpret_cast<char const *>(dat), bytes); });
+  };
+  struct Section {
+    size_t count, bytes;
+    Writer write;
+  };
+  size_t badBytes = compress ? badPacked.bytes() : cd.bad.size() * sizeof(Interval);
+  size_t mlfBytes = compress ? mlfPacked.bytes() : 0;
+  Section secs[NUM_SECTIONS] = {
+      {cd.name.size(), cd.name.size(), raw(cd.name.data(), cd.name.size())},
+      {lbls.size(), lbls.size() * sizeof(IdxLabel), raw(lbls.data(), lbls.size() * sizeof(IdxLabel))},
+      {cd.regions.size(), cd.regions.size() * sizeof(Interval),
+       raw(cd.regions.data(), cd.regions.size() * sizeof(Interval))},
+      {cd.bad.size(), badBytes,
+       compress ? Writer([&](ostream &o) { badPacked.write(o); }) : raw(cd.bad.data(), badBytes)},
+      {0, 0, raw(nullptr, 0)},
+      {mlfPacked.size(), mlfBytes, [&](ostream &o) {
+         if (compress)
+           mlfPacked.write(o);
+       }},
+      {compress ? 0 : cd.factBits.size(), compress ? 0 : cd.factBits.bytes(),
+       [&](ostream &o) {
+         if (!compress)
+           cd.factBits.write(o);
+       }},
+      {cd.regionStats.size(), cd.regionStats.size() * sizeof(RegionStats),
+       raw(cd.regionStats.data(), cd.regionStats.size() * sizeof(RegionStats))}};
+  size_t off = alignUp(sizeof(h));
+  for (size_t j = 0; j < NUM_SECTIONS; j++) {
+    h.sec[j].offset = off;
+    h.sec[j].count = secs[j].count;
+    off = alignUp(off + secs[j].bytes);
+  }
 
-    binwrite(o, cd.numbad);
-    binwrite(o, (size_t)cd.bad.size());
-    for (auto i : cd.bad){
-      binwrite(o, i.first);
-      binwrite(o, i.second);
+  return with_file_out(file, [&](ostream &o) {
+    binwrite(o, h);
+    size_t pos = sizeof(h);
+    for (size_t j = 0; j < NUM_SECTIONS; j++) {
+      for (; pos < h.sec[j].offset; pos++)
+        o.put(0);
+      secs[j].write(o);
+      pos += secs[j].bytes;
     }
+    return (bool)o;
+  }, ios::binary);
+}
 
-    binwrite(o, (size_t)cd.fstRegionFact.size());
-    for (auto i : cd.fstRegionFact)
-      binwrite(o, i);
-    binwrite(o, (size_t)cd.mlf.size());
-    for (auto i : cd.mlf)
-      binwrite(o, i);
-
-    return true;
-  });
+//take stream, consume magic string, return index version (0 = no index)
+size_t readVersion(istream &fin) {
+  string m(magicstr.size(), 0);
+  fin.read(&m[0], m.size());
+  if (fin && m == magicstr)
+    return 1;
+  if (!fin || m != magicstr2.substr(0, m.size()))
+    return 0;
+  string rest(magicstr2.size() - m.size(), 0);
+  fin.read(&rest[0], rest.size());
+  return fin && m + rest == magicstr2 ? 2 : 0;
 }
 
 //take stream, consume magic string, return success value
 bool readMagic(istream &fin) {
-  char tmp;
-  for (size_t i = 0; i<magicstr.size(); i++) {
-    binread(fin, tmp);
-    if (tmp != magicstr[i]) {
-      return false;
-    }
+  return readVersion(fin) != 0;
+}
+
+// check version and byte order of a version 2 header, clear missing sections
+static bool checkHeader(IdxHeader &h) {
+  if (h.byteorder != BYTE_ORDER_MARK) {
+    cerr << "ERROR: Index files are little endian, they can not be used on this machine!" << endl;
+    return false;
   }
+  if (h.version != IDX_VERSION || h.numSections < MIN_SECTIONS || h.numSections > NUM_SECTIONS) {
+    cerr << "ERROR: Unsupported index file version " << h.version << "!" << endl;
+    return false;
+  }
+  for (size_t j = h.numSections; j < NUM_SECTIONS; j++)
+    h.sec[j].offset = h.sec[j].count = 0;
   return true;
 }
 
-// load precomputed data from stdin (when file=nullptr) or some file
-bool loadData(ComplexityData &dat, char const *file, bool onlyInfo) {
+// read the header of a version 2 index after the magic string
+static bool readHeader(istream &fin, IdxHeader &h) {
+  memcpy(h.magic, magicstr2.data(), sizeof(h.magic));
+  fin.read(reinterpret_cast<char *>(&h) + sizeof(h.magic), sizeof(h) - sizeof(h.magic));
+  if (!fin) {
+    cerr << "ERROR: Index file is truncated!" << endl;
+    return false;
+  }
+  return checkHeader(h);
+}
+
+// read only the sequence length from an index file (to choose the index type)
+bool loadLength(size_t &len, char const *file) {
   if (!file) {
     cerr << "ERROR: Can not load binary index file from pipe!"
       << " Please pass it as argument!" << endl;
     return false;
   }
   return with_file_in(file, [&](istream &fin) {
-  // return with_mmap(file, [&](MMapReader &fin) {
-    if (!readMagic(fin)) {
+    size_t version = readVersion(fin);
+    if (!version) {
       cerr << "ERROR: This does not look like an index file!" << endl;
       return false;
     }
-
-    char tmp;
+    if (version == 2) {
+      IdxHeader h;
+      if (!readHeader(fin, h))
+        return false;
+      len = h.len;
+      return true;
+    }
     size_t namelen;
     binread(fin,namelen);
-    for (size_t j=0; j<namelen; j++) {
+    fin.seekg(namelen, ios::cur);
+    binread(fin,len);
+    return (bool)fin;
+  }, ios::in|ios::binary);
+}
+
+// first j in [l, r) with get(j) >= x, for get non-decreasing on [l, r)
+template <typename F> static size_t lowerBoundBy(size_t l, size_t r, uint64_t x, F get) {
+  while (l < r) {
+    size_t m = l + (r - l) / 2;
+    if ((uint64_t)get(m) < x)
+      l = m + 1;
+    else
+      r = m;
+  }
+  return l;
+}
+
+// bad intervals needed for queries in [from, to) as index range into the
+// num intervals with bounds fst(j), snd(j): the ones overlapping it and one
+// neighbour on each side, so lookups behave like on the complete list
+template <typename F, typename S>
+static pair<size_t, size_t> badSlice(size_t num, size_t from, size_t to, F fst, S snd) {
+  size_t l = lowerBoundBy(0, num, from, snd);
+  size_t r = lowerBoundBy(l, num, to, fst);
+  return make_pair(l ? l - 1 : 0, min(num, r + 1));
+}
+
+// rank bit vector of the factor starts facts, which are the ones in [from, to)
+// (all for a complete load), it only covers the positions queries can use
+template <typename T>
+static void factSlice(ComplexityData<T> &dat, vector<uint64_t> const &facts, size_t from,
+                      size_t to) {
+  size_t n = min(to, dat.len) + 1;
+  dat.factBits = RankBitVec(n, facts, min(from, n - 1));
+}
+
+// load version 1 index, everything is copied
+template <typename T>
+static bool loadDataV1(ComplexityData<T> &dat, istream &fin, bool onlyInfo, size_t from,
+                       size_t to) {
+  char tmp;
+  size_t namelen;
+  binread(fin,namelen);
+  for (size_t j=0; j<namelen; j++) {
+    binread(fin,tmp);
+    dat.name += tmp;
+  }
+  binread(fin,dat.len);
+  binread(fin,dat.gc);
+
+  size_t rnum;
+  binread(fin,rnum);
+  dat.regions.resize(rnum);
+  dat.labels.resize(rnum);
+  for (size_t j = 0; j < rnum; j++) {
+    size_t s, l;
+    binread(fin,s);
+    binread(fin,l);
+    dat.regions[j] = make_pair(s, l);
+  }
+  for (size_t j = 0; j < rnum; j++) {
+    size_t lbllen;
+    binread(fin,lbllen);
+    for (size_t k=0; k<MAX_LABEL_LEN; k++) {
       binread(fin,tmp);
-      dat.name += tmp;
+      if (k < lbllen)
+        dat.labels[j] += tmp;
     }
-    binread(fin,dat.len);
-    binread(fin,dat.gc);
+  }
 
-    size_t rnum;
-    binread(fin,rnum);
-    dat.regions.resize(rnum);
-    dat.labels.resize(rnum);
-    for (size_t j = 0; j < rnum; j++) {
-      size_t s, l;
-      binread(fin,s);
-      binread(fin,l);
-      dat.regions[j] = make_pair(s, l);
-    }
-    for (size_t j = 0; j < rnum; j++) {
-      size_t lbllen;
-      binread(fin,lbllen);
-      for (size_t k=0; k<MAX_LABEL_LEN; k++) {
-        binread(fin,tmp);
-        if (k < lbllen)
-          dat.labels[j] += tmp;
-      }
-    }
+  binread(fin, dat.numbad);
+  if (onlyInfo)
+    return (bool)fin;
+
+  size_t bnum;
+  binread(fin,bnum);
+  dat.bad.resize(bnum);
+  for (size_t j = 0; j < bnum; j++) {
+    size_t l, r;
+    binread(fin,l);
+    binread(fin,r);
+    dat.bad[j] = make_pair(l, r);
+  }
 
-    binread(fin, dat.numbad);
-
-    size_t bnum;
-    binread(fin,bnum);
-    if (!onlyInfo)
-      dat.bad.resize(bnum);
-    for (size_t j = 0; j < bnum; j++) {
-      size_t l, r;
-      binread(fin,l);
-      binread(fin,r);
-      if (!onlyInfo)
-        dat.bad[j] = make_pair(l, r);
-    }
+  bool partial = from > 0 || to < dat.len;
+  size_t ffnum; // first factor of each region, not needed
+  binread(fin,ffnum);
+  fin.seekg(ffnum * sizeof(size_t), ios::cur);
+
+  size_t fnum;
+  binread(fin,fnum);
+  size_t f0 = 0, f1 = fnum; // factors to read
+  if (partial) { // binary search the sorted factors in the file
+    streampos pos = fin.tellg();
+    auto fact = [&](size_t j) {
+      size_t x = 0;
+      fin.seekg(pos + (streamoff)(j * sizeof(size_t)));
+      binread(fin, x);
+      return x;
+    };
+    f0 = lowerBoundBy(0, fnum, from, fact);
+    f1 = lowerBoundBy(f0, fnum, to, fact);
+    fin.seekg(pos + (streamoff)(f0 * sizeof(size_t)));
+  }
+  vector<uint64_t> facts(f1 - f0);
+  for (size_t j = 0; j < f1 - f0; j++)
+    binread(fin, facts[j]);
+  if (!fin)
+    return false;
+  factSlice(dat, facts, from, to);
+  if (!partial) // needs all factors
+    calcRegionStats(dat, vector<double>()); // gc of regions is unknown
+  return true;
+}
+
+// decode values [from, to) of v in parallel chunks of blocks, calling f(i, value)
+template <typename F> static void unpackBlocks(DeltaVec const &v, size_t from, size_t to, F f) {
+  size_t b0 = from / DeltaVec::BLOCK, b1 = (to + DeltaVec::BLOCK - 1) / DeltaVec::BLOCK;
+  parallelFor(b1 - b0, args.threads, [&](unsigned, size_t l, size_t r) {
+    v.decode(max(from, (b0 + l) * DeltaVec::BLOCK), min(to, (b0 + r) * DeltaVec::BLOCK), f);
+  });
+}
 
-    size_t ffnum;
-    binread(fin,ffnum);
-    if (!onlyInfo)
-      dat.fstRegionFact.resize(ffnum);
-    for (size_t j = 0; j < ffnum; j++) {
-      size_t fi;
-      binread(fin,fi);
-      if (!onlyInfo)
-        dat.fstRegionFact[j] = fi;
+// load version 2 index, the arrays point into a mapping of the file, so
+// only the pages of the queried range are read
+template <typename T>
+static bool loadDataV2(ComplexityData<T> &dat, char const *file, bool onlyInfo, size_t from,
+                       size_t to) {
+  auto map = map_file(file);
+  if (!map)
+    return false;
+  IdxHeader h;
+  if (map->sz < sizeof(h)) {
+    cerr << "ERROR: Index file is truncated!" << endl;
+    return false;
+  }
+  memcpy(&h, map->dat, sizeof(h));
+  if (!checkHeader(h))
+    return false;
+  // bytes per entry, 0 for sections with their own layout
+  size_t widths[NUM_SECTIONS] = {1, sizeof(IdxLabel), sizeof(Interval),
+                                 h.flags & IDX_PACKED_BAD ? 0 : sizeof(Interval),
+                                 sizeof(size_t), h.flags & IDX_PACKED_MLF ? 0 : h.factWidth, 0,
+                                 sizeof(RegionStats)};
+  for (size_t j = 0; j < NUM_SECTIONS; j++)
+    if (h.sec[j].offset % 8 != 0 || h.sec[j].offset > map->sz ||
+        (widths[j] && h.sec[j].count > (map->sz - h.sec[j].offset) / widths[j])) {
+      cerr << "ERROR: Index file is corrupt or truncated!" << endl;
+      return false;
     }
+  if (h.factWidth != 4 && h.factWidth != 8) {
+    cerr << "ERROR: Index file is corrupt!" << endl;
+    return false;
+  }
 
-    size_t fnum;
-    binread(fin,fnum);
+  auto at = [&](size_t j) { return map->dat + h.sec[j].offset; };
+  dat.name.assign(at(SEC_NAME), h.sec[SEC_NAME].count);
+  dat.len = h.len;
+  dat.gc = h.gc;
+  dat.numbad = h.numbad;
 
-    if (!onlyInfo)
-      dat.mlf.resize(fnum);
-    for (size_t j = 0; j < fnum; j++) {
-      size_t fact;
-      binread(fin,fact);
-      if (!onlyInfo)
-        dat.mlf[j] = fact;
-    }
+  size_t rnum = h.sec[SEC_REGIONS].count;
+  if (h.sec[SEC_LABELS].count != rnum) {
+    cerr << "ERROR: Index file is corrupt!" << endl;
+    return false;
+  }
+  Interval const *regs = reinterpret_cast<Interval const *>(at(SEC_REGIONS));
+  IdxLabel const *lbls = reinterpret_cast<IdxLabel const *>(at(SEC_LABELS));
+  dat.regions.assign(regs, regs + rnum);
+  dat.labels.resize(rnum);
+  for (size_t j = 0; j < rnum; j++)
+    dat.labels[j].assign(lbls[j].str, min((size_t)lbls[j].len, MAX_LABEL_LEN));
+  size_t snum = h.sec[SEC_REGIONSTATS].count;
+  if (snum && snum != rnum) {
+    cerr << "ERROR: Index file is corrupt!" << endl;
+    return false;
+  }
+  RegionStats const *stats = reinterpret_cast<RegionStats const *>(at(SEC_REGIONSTATS));
+  dat.regionStats.assign(stats, stats + snum);
+  if (onlyInfo)
+    return true;
 
+  // packed sections are decoded
+  DeltaVec badPacked, mlfPacked;
+  auto unpack = [&](size_t j, DeltaVec &v, size_t num) {
+    size_t sz = map->sz - h.sec[j].offset;
+    if (!DeltaVec::borrow(at(j), sz, map, v) || v.size() != num) {
+      cerr << "ERROR: Index file is corrupt or truncated!" << endl;
+      return false;
+    }
     return true;
+  };
+
+  bool partial = from > 0 || to < dat.len;
+  size_t bnum = h.sec[SEC_BAD].count;
+  if (h.flags & IDX_PACKED_BAD) {
+    if (!unpack(SEC_BAD, badPacked, 2 * bnum))
+      return false;
+    auto bs = make_pair((size_t)0, bnum);
+    if (partial)
+      bs = badSlice(bnum, from, to, [&](size_t j) { return badPacked[2 * j]; },
+                    [&](size_t j) { return badPacked[2 * j + 1]; });
+    dat.bad.resize(bs.second - bs.first);
+    unpackBlocks(badPacked, 2 * bs.first, 2 * bs.second, [&](size_t j, uint64_t x) {
+      j -= 2 * bs.first;
+      (j % 2 ? dat.bad[j / 2].second : dat.bad[j / 2].first) = x;
+    });
+  } else {
+    Interval const *bad = reinterpret_cast<Interval const *>(at(SEC_BAD));
+    auto bs = make_pair((size_t)0, bnum);
+    if (partial)
+      bs = badSlice(bnum, from, to, [&](size_t j) { return bad[j].first; },
+                    [&](size_t j) { return bad[j].second; });
+    dat.bad = MappedVec<Interval>::borrow(bad + bs.first, bs.second - bs.first, map);
+  }
+  if (h.sec[SEC_FACTBITS].count) { // used from the mapping, only queried pages are read
+    if (!RankBitVec::borrow(at(SEC_FACTBITS), map->sz - h.sec[SEC_FACTBITS].offset, map,
+                            dat.factBits) ||
+        dat.factBits.size() != dat.len + 1) {
+      cerr << "ERROR: Index file is corrupt or truncated!" << endl;
+      return false;
+    }
+  } else { // built from the (packed or older raw) factors
+    size_t fnum = h.sec[SEC_MLF].count;
+    size_t f0 = 0, f1 = fnum; // factors to load
+    vector<uint64_t> facts;
+    if (h.flags & IDX_PACKED_MLF) {
+      if (!unpack(SEC_MLF, mlfPacked, fnum))
+        return false;
+      if (partial) {
+        f0 = mlfPacked.lowerBound(from);
+        f1 = max(f0, mlfPacked.lowerBound(to));
+      }
+      facts.resize(f1 - f0);
+      unpackBlocks(mlfPacked, f0, f1, [&](size_t j, uint64_t x) { facts[j - f0] = x; });
+    } else {
+      auto fact = [&](size_t j) -> uint64_t {
+        if (h.factWidth == 4)
+          return reinterpret_cast<uint32_t const *>(at(SEC_MLF))[j];
+        return reinterpret_cast<uint64_t const *>(at(SEC_MLF))[j];
+      };
+      if (partial) {
+        f0 = lowerBoundBy(0, fnum, from, fact);
+        f1 = lowerBoundBy(f0, fnum, to, fact);
+      }
+      facts.resize(f1 - f0);
+      for (size_t j = f0; j < f1; j++)
+        facts[j - f0] = fact(j);
+    }
+    if (!facts.empty() && facts.back() > dat.len) {
+      cerr << "ERROR: Index file is corrupt!" << endl;
+      return false;
+    }
+    factSlice(dat, facts, from, to);
+  }
+  if (dat.regionStats.empty() && !partial) // older file, gc of regions is unknown
+    calcRegionStats(dat, vector<double>());
+  return true;
+}
+
+// load precomputed data from stdin (when file=nullptr) or some file
+template <typename T>
+bool loadData(ComplexityData<T> &dat, char const *file, bool onlyInfo, size_t from, size_t to) {
+  if (!file) {
+    cerr << "ERROR: Can not load binary index file from pipe!"
+      << " Please pass it as argument!" << endl;
+    return false;
+  }
+  size_t version = 0;
+  bool ok = with_file_in(file, [&](istream &fin) {
+    version = readVersion(fin);
+    if (!version) {
+      cerr << "ERROR: This does not look like an index file!" << endl;
+      return false;
+    }
+    return version != 1 || loadDataV1(dat, fin, onlyInfo, from, to);
   }, ios::in|ios::binary);
+  if (ok && version == 2)
+    return loadDataV2(dat, file, onlyInfo, from, to);
+  return ok;
 }
 
 bool renameRegions(char const *file, vector<string> const &names) {
@@ -177,86 +533,95 @@ bool renameRegions(char const *file, vector<string> const &names) {
     return false;
   }
   return with_file(file, [&](fstream &fs) {
-    char tmp;
-    for (size_t i = 0; i<magicstr.size(); i++) {
-      binread(fs, tmp);
-      if (tmp != magicstr[i]) {
-        cerr << "ERROR: This does not look like an index file!" << endl;
-        return false;
-      }
+    size_t version = readVersion(fs);
+    if (!version) {
+      cerr << "ERROR: This does not look like an index file!" << endl;
+      return false;
     }
-    size_t tmpsz;
-    binread(fs,tmpsz);
-    for (size_t j=0; j<tmpsz; j++)
-      binread(fs,tmp);
-    double gc;
-    binread(fs,tmpsz);
-    binread(fs,gc);
 
     size_t rnum;
-    binread(fs,rnum);
-    if (rnum != names.size()) {
-      cerr << "ERROR: number of given names and regions does not match!" << endl;
-      return false;
-    }
-    for (size_t j = 0; j < rnum; j++) {
+    if (version == 2) {
+      IdxHeader h;
+      if (!readHeader(fs, h))
+        return false;
+      rnum = h.sec[SEC_LABELS].count;
+      fs.seekp(h.sec[SEC_LABELS].offset);
+    } else {
+      char tmp;
+      size_t tmpsz;
       binread(fs,tmpsz);
+      for (size_t j=0; j<tmpsz; j++)
+        binread(fs,tmp);
+      double gc;
       binread(fs,tmpsz);
+      binread(fs,gc);
+
+      binread(fs,rnum);
+      for (size_t j = 0; j < rnum; j++) {
+        binread(fs,tmpsz);
+        binread(fs,tmpsz);
+      }
+      fs.seekp(fs.tellg());
     }
-    fs.seekp(fs.tellg());
-    for (auto &s : names) {
-      binwrite(fs, s.size());
-      for (size_t i=0; i<MAX_LABEL_LEN; i++)
-        binwrite(fs, i < s.size() ? s[i] : (char)0);
+    if (rnum != names.size()) {
+      cerr << "ERROR: number of given names and regions does not match!" << endl;
+      return false;
     }
+    for (auto &s : names)
+      binwrite(fs, toIdxLabel(s));
     return true;
   }, fstream::in|fstream::out|fstream::binary);
 }
 
 // given sequences from a fasta file, calculate match factors and runs
-void extractData(ComplexityData &dat, FastaFile &file) {
-  //construct concatenated sequence:
-  string s = "";
-  size_t offset=0;
-  for (auto &it : file.seqs) { //extract region list from file
-    dat.regions.push_back(make_pair(offset, it.seq.size()));
-    dat.labels.push_back(it.name /* +" "+it.comment */);
-    offset += it.seq.size();
-
-    s += it.seq;
-    it.seq = ""; //free memory of separate sequences
+template <typename T> void extractData(ComplexityData<T> &dat, FastaFile &file) {
+  //concatenated sequence, followed by $, its reverse complement and $ in
+  //the same buffer
+  file.concat();
+  char *s = file.text.get();
+  size_t n = file.len;
+  vector<double> gc;
+  for (size_t i = 0; i < file.seqs.size(); i++) { //region list from file
+    dat.regions.push_back(file.regions[i]);
+    gc.push_back(gcContent(s + file.regions[i].first, file.regions[i].second));
+    dat.labels.push_back(file.seqs[i].name /* +" "+it.comment */);
   }
 
   dat.name = file.filename;
-  dat.gc = gcContent(s);
-  dat.len = s.size();
+  dat.gc = gcContent(s, n);
+  dat.len = n;
+
+  s[n] = '$';
+  revComp(s, n, s + n + 1);
+  s[2 * n + 1] = '$';
+  s[2 * n + 2] = '\0';
+  Fact<T> mlf;
+  if (args.m) { // suffix sorting in scratch files
+    tick();
+    ExtSa ext;
+    bool ok = buildExtSa(ext, s, 2 * n + 2, args.m << 20, args.tmpdir, args.threads);
+    tock("buildExtSa (both strands)");
+
+    tick();
+    ok = ok && computeMLFactExt(mlf, ext, s, args.m << 20);
+    removeExtSa(ext);
+    tock("computeMLFactExt");
+    if (!ok)
+      exit(1);
+  } else {
+    tick();
+    idx_vec<T> sa = getSa<T>(s, 2 * n + 2, args.threads); // sa for seq+$+revseq+$
+    tock("getSa (both strands)");
+
+    tick();
+    computeMLFactPlcp(mlf, s, 2 * n + 2, move(sa), args.threads);
+    tock("computeMLFactPlcp");
+  }
 
-  s = s + "$" + revComp(s) + "$";
-  tick();
-  Esa esa(s.c_str(), s.size()); // esa for seq+$+revseq+$
-  tock("getEsa (both strands)");
+  s[n + 1] = '\0'; // drop complementary seq.
+  mlf.str = s;
 
-  tick();
-  Fact mlf;
-  computeMLFact(mlf, esa);
-  tock("computeMLFact");
-
-  s.resize(s.size() / 2); // drop complementary seq.
-  s.shrink_to_fit();
-  mlf.str = esa.str = s.c_str();
-  esa.n = s.size();
-
-  size_t currreg=0;
-  size_t idx=0;
-  for (auto f : mlf.fact) {
-    dat.mlf.push_back(f);
-    if (dat.fstRegionFact.size() < dat.regions.size() &&
-        (dat.fstRegionFact.empty() || (dat.fstRegionFact.back()<f && f>=dat.regions[currreg].first))) {
-      dat.fstRegionFact.push_back(idx);
-      currreg++;
-    }
-    idx++;
-  }
+  dat.factBits = RankBitVec(dat.len + 1, mlf.fact);
 
   if (args.p) {
     // esa.print();
@@ -264,28 +629,43 @@ void extractData(ComplexityData &dat, FastaFile &file) {
     mlf.print();
   }
 
-  // get list of bad intervals
+  // get list of bad intervals (from the file or by scanning the text)
   tick();
-  bool insidebad = false;
-  size_t start = 0;
-  string validchars = "ACGT$";
-  for (size_t i = 0; i < s.size(); i++) {
-    bool valid = validchars.find(s[i]) != string::npos;
-    if (insidebad && valid) {
-      insidebad = false;
-      dat.bad.push_back(make_pair(start, i - 1));
-    } else if (!insidebad && !valid) {
-      start = i;
-      insidebad = true;
+  if (file.knownBad)
+    dat.bad = MappedVec<pair<size_t, size_t>>(file.bad);
+  else {
+    bool insidebad = false;
+    size_t start = 0;
+    string validchars = "ACGT$";
+    for (size_t i = 0; i < n + 1; i++) {
+      bool valid = validchars.find(s[i]) != string::npos;
+      if (insidebad && valid) {
+        insidebad = false;
+        dat.bad.push_back(make_pair(start, i - 1));
+      } else if (!insidebad && !valid) {
+        start = i;
+        insidebad = true;
+      }
     }
+    if (insidebad) // push last one, if we are inside
+      dat.bad.push_back(make_pair(start, n));
   }
-  if (insidebad) // push last one, if we are inside
-    dat.bad.push_back(make_pair(start, s.size() - 1));
 
   //calculate total number of bad nucleotides for global mode
   dat.numbad=0;
   for (auto &bad : dat.bad)
     dat.numbad += bad.second - bad.first + 1;
+  calcRegionStats(dat, gc);
+  file.text.reset();
 
   tock("find bad intervals");
 }
+
+template bool saveData(ComplexityData<uint32_t> &cd, char const *file, bool compress);
+template bool saveData(ComplexityData<uint64_t> &cd, char const *file, bool compress);
+template bool loadData(ComplexityData<uint32_t> &dat, char const *file, bool onlyInfo,
+                       size_t from, size_t to);
+template bool loadData(ComplexityData<uint64_t> &dat, char const *file, bool onlyInfo,
+                       size_t from, size_t to);
+template void extractData(ComplexityData<uint32_t> &dat, FastaFile &file);
+template void extractData(ComplexityData<uint64_t> &dat, FastaFile &file);
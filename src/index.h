@@ -1,13 +1,26 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <utility>
 #include "fastafile.h"
+#include "mappedvec.h"
+#include "rankbitvec.h"
+
+// precomputed values of one region for whole region queries
+struct RegionStats {
+  uint64_t facts;  // match factors in region (region start counts as one)
+  uint64_t numbad; // bad nucleotides in region
+  uint64_t badivs; // bad intervals overlapping region
+  double gc;       // gc content of region (NaN if unknown)
+};
 
 // All information from a sequence required to calculate complexity plots
 // a file stores exactly one such object with one or more regions defined
-// by the fasta sequences within the file
-struct ComplexityData {
+// by the fasta sequences within the file. T is the index type the factors
+// were computed with. The arrays can point directly into a memory mapped index
+// file.
+template <typename T = uint64_t> struct ComplexityData {
   std::string name;                       // name of sequence
   size_t len;                             // length of sequence
   double gc;                              // gc content of sequence
@@ -15,20 +28,27 @@ struct ComplexityData {
   // for sequence regions in joined sequence:
   std::vector<std::string> labels;                //region labels
   std::vector<std::pair<size_t, size_t>> regions; //regions (start, length)
+  std::vector<RegionStats> regionStats;           //statistics of regions
 
   // for global mode we need to ignore NNN... blocks:
   size_t numbad;                               // total # of bad nucleotides
-  std::vector<std::pair<size_t, size_t>> bad;  // list of bad intervals (start,end)
+  MappedVec<std::pair<size_t, size_t>> bad;  // list of bad intervals (start,end)
 
-  std::vector<size_t> fstRegionFact;              //for each region, index of first factor
-  std::vector<size_t> mlf;                // match factors
+  RankBitVec factBits;                  // marks the match factor starts
 };
 
 const size_t MAX_LABEL_LEN = 32;
 
 bool readMagic(istream &fin);
-bool loadData(ComplexityData &cplx, char const *file, bool onlyInfo=false);
-bool saveData(ComplexityData &cplx, char const *file);
+bool loadLength(size_t &len, char const *file);
+// load an index file, with onlyInfo everything up to the number of bad
+// nucleotides. If only positions in [from, to) are queried later, only the
+// factor starts in it and at least the bad intervals overlapping it are read.
+template <typename T>
+bool loadData(ComplexityData<T> &cplx, char const *file, bool onlyInfo=false, size_t from=0,
+              size_t to=SIZE_MAX);
+template <typename T>
+bool saveData(ComplexityData<T> &cplx, char const *file, bool compress=false);
 bool renameRegions(char const *file, std::vector<std::string> const &names);
 
-void extractData(ComplexityData &cplx, FastaFile &file);
+template <typename T> void extractData(ComplexityData<T> &cplx, FastaFile &file);
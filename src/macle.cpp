@@ -3,42 +3,58 @@
 #include <iomanip>
 #include <queue>
 #include <map>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
 using namespace std;
 
 #include "args.h"
 #include "bench.h"
 #include "complexity.h"
+#include "config.h"
+#include "output.h"
+#include "parallel.h"
 #include "util.h"
 
-void printIndexInfo(ComplexityData const &dat) {
-  cout << "name:\t" << dat.name << endl
+//stream of the results, files processed at the same time use their own buffer
+thread_local ostream *resOut = &cout;
+
+template <typename T> void printIndexInfo(ComplexityData<T> const &dat) {
+  *resOut << "name:\t" << dat.name << endl
         << "len:\t" << dat.len << endl
         << "gc:\t" << dat.gc << endl
         << "bad:\t" << (double)dat.numbad / dat.len << endl;
-  cout << "sequences:" << endl;
+  *resOut << "sequences:" << endl;
   for (size_t j=0; j<dat.regions.size(); j++) {
-    cout << "\tindex: " << (j+1);
-    cout << "\tlen: " << dat.regions[j].second;
-    cout << "\tname: " << dat.labels[j] << endl;
+    *resOut << "\tindex: " << (j+1);
+    *resOut << "\tlen: " << dat.regions[j].second;
+    *resOut << "\tname: " << dat.labels[j] << endl;
   }
 }
 
-void gnuplotCode(uint32_t w, uint32_t k, int n) {
-  cout << "set key autotitle columnheader; set ylabel \"window complexity\"; "
-    << "set xlabel \"window offset (w=" << w << ", k="<<k<<")\"; ";
+void gnuplotCode(vector<size_t> const &ws, size_t k, int n) {
+  *resOut << "set key autotitle columnheader; set ylabel \"window complexity\"; "
+    << "set xlabel \"window offset (w=";
+  for (size_t i = 0; i < ws.size(); i++)
+    *resOut << (i ? "," : "") << ws[i];
+  *resOut << ", k="<<k<<")\"; ";
   for (int i = 0; i < n; i++)
-    cout << (i ? ", ''" : "plot \"$PLOTFILE\"") << " using 2:"<<(i+3)<<" with lines";
-  cout << ";" << endl;
+    *resOut << (i ? ", ''" : "plot \"$PLOTFILE\"") << " using 2:"<<(i+3)<<" with lines";
+  *resOut << ";" << endl;
 }
 
-// print data: X Y1 ... Yn
-void printPlot(Task &t, vector<string> &lbls, vector<pair<size_t,size_t>> &regs, uint32_t w, uint32_t k, ResultMat const &ys) {
+//rows formatted at once in window mode, bounds the buffered output
+const size_t OUT_BLOCK = 1 << 20;
+
+// region and window center of each row
+vector<pair<uint32_t,size_t>> rowPositions(Task &t, vector<pair<size_t,size_t>> &regs, size_t w, size_t k, size_t rows) {
   queue<pair<size_t,size_t>> rs;
   for (auto &r : regs)
     rs.emplace(r);
   uint32_t rcnt = t.idx < 0 ? 0 : t.idx; //region counter for output
 
-  for (size_t j = 0; j < ys[0].second.size(); j++) {
+  vector<pair<uint32_t,size_t>> pos(rows);
+  for (size_t j = 0; j < rows; j++) {
     size_t off = j * k + w / 2;
     // cout << regs[idx].first + off << "\t";
     if (t.idx < 0) {
@@ -48,26 +64,78 @@ void printPlot(Task &t, vector<string> &lbls, vector<pair<size_t,size_t>> &regs,
       }
       off -= rs.front().first;
     }
-    string lbl = (t.idx<0 && ys[0].second.size()==1) ? "<file>" : lbls[rcnt];
-    cout << lbl << "\t" << off << "\t"; // center of window
-    for (size_t i = 0; i < ys.size(); i++)
-      cout << ys[i].second[j] << (i<ys.size()-1 ? "\t" : "");
-    cout << endl;
+    pos[j] = make_pair(rcnt, off);
+  }
+  return pos;
+}
+
+// print data: X Y1 ... Yn
+void printPlot(Task &t, vector<string> &lbls, vector<pair<uint32_t,size_t>> const &pos, ResultMat const &ys) {
+  // format blocks of rows, the chunks of a block in parallel, print them in order
+  size_t rows = pos.size();
+  int prec = resOut->precision();
+  for (size_t b = 0; b < rows; b += OUT_BLOCK) {
+    size_t m = min(OUT_BLOCK, rows - b);
+    vector<OutBuf> out(numChunks(m, args.threads), OutBuf(prec));
+    parallelFor(m, args.threads, [&](unsigned c, size_t from, size_t to) {
+      OutBuf &os = out[c];
+      for (size_t j = b + from; j < b + to; j++) {
+        os.put((t.idx<0 && rows==1) ? string("<file>") : lbls[pos[j].first]);
+        os.put('\t');
+        os.putUInt(pos[j].second); // center of window
+        for (size_t i = 0; i < ys.size(); i++) {
+          os.put('\t');
+          os.putFixed(ys[i].second[j]);
+        }
+        os.put('\n');
+      }
+    });
+    for (auto &o : out)
+      o.writeTo(*resOut);
+  }
+  *resOut << flush;
+}
+
+// rows of each sequence with the window centers in sequence coordinates
+vector<TrackSeq> trackSeqs(Task &t, vector<string> &lbls, vector<pair<size_t,size_t>> &regs,
+                           vector<pair<uint32_t,size_t>> const &pos, size_t w) {
+  vector<TrackSeq> seqs;
+  if (t.idx < 0 && pos.size() == 1) { //whole file as one window
+    size_t len = regs.empty() ? 0 : regs.back().first + regs.back().second;
+    seqs.push_back(TrackSeq{"<file>", len, 0, 1, w / 2});
+    return seqs;
+  }
+  for (size_t j = 0; j < pos.size(); j++) {
+    if (j == 0 || pos[j].first != pos[j-1].first) {
+      size_t start = t.idx < 0 ? 0 : t.start;
+      seqs.push_back(TrackSeq{lbls[pos[j].first], regs[pos[j].first].second, j, 0, start + pos[j].second});
+    }
+    seqs.back().rows++;
   }
+  return seqs;
 }
 
-void printResults(Task &t, vector<string> &lbls, vector<pair<size_t,size_t>> &regs, size_t w, size_t k, ResultMat const &ys, bool gnuplot) {
-  if (!gnuplot) { //simple output
-    printPlot(t, lbls, regs, w, k, ys);
+void printResults(Task &t, vector<string> &lbls, vector<pair<size_t,size_t>> &regs, vector<size_t> const &ws, size_t k, ResultMat const &ys, bool gnuplot) {
+  size_t w = *max_element(ws.begin(), ws.end()); // the rows are centered in the biggest windows
+  auto pos = rowPositions(t, regs, w, k, ys[0].second.size());
+  if (args.o != OutFormat::Text) {
+    auto seqs = trackSeqs(t, lbls, regs, pos, w);
+    if (args.o == OutFormat::BedGraph)
+      writeBedGraph(*resOut, ys, seqs, k, resOut->precision());
+    else
+      writeTrack(*resOut, ys, ws, seqs, k, args.o == OutFormat::Zoom);
+    *resOut << flush;
+  } else if (!gnuplot) { //simple output
+    printPlot(t, lbls, pos, ys);
   } else { //macle_plot
-    cout << "MACLE_PLOT" << endl; //magic keyword
-    gnuplotCode(w, k, ys.size()); // gnuplot control code
+    *resOut << "MACLE_PLOT" << endl; //magic keyword
+    gnuplotCode(ws, k, ys.size()); // gnuplot control code
     // print column header (for plot labels)
-    cout << "offset\t";
+    *resOut << "offset\t";
     for (size_t j = 0; j < ys.size(); j++) // columns for each seq
-      cout << "\"" << ys[j].first << "\"\t";
-    cout << endl;
-    printPlot(t, lbls, regs, w, k, ys); // print plot itself
+      *resOut << "\"" << ys[j].first << "\"\t";
+    *resOut << endl;
+    printPlot(t, lbls, pos, ys); // print plot itself
   }
 }
 
@@ -82,26 +150,208 @@ bool check_unique_names(FastaFile &ff) {
   return true;
 }
 
-//load / extract data, show results
-void processFile(char const *file) {
-  ComplexityData dat;
+//resolve region name of task and check its range, returns false with an
+//error message if it is invalid
+template <typename T>
+bool checkTask(Task &task, ComplexityData<T> const &dat, map<string, int64_t> const &nameidx,
+               string &err) {
+  //get index of region if not global adressing
+  if (task.lbl != "") {
+    auto it = nameidx.find(task.lbl);
+    if (it == nameidx.end()) {
+      err = "Invalid sequence name: " + task.lbl;
+      return false;
+    }
+    task.idx = it->second;
+  }
+  //sanity check for manually set index values
+  if (task.idx < -1 || task.idx >= (int64_t)dat.regions.size()) {
+    err = "Invalid sequence index (" + to_string(task.idx) + ") for name " + task.lbl;
+    return false;
+  }
 
-  //infer whether given file is an index (user can forget -i)
-  if (file && with_file_in(file, readMagic))
-    args.i = true;
+  size_t reglen = task.idx >= 0 ? dat.regions[task.idx].second : dat.len;
+  if ((task.start!=0 || task.end!=0) && (task.start > task.end || task.start >= reglen ||
+      task.end-task.start+1 > reglen - task.start)) {
+    err = "Invalid range: " + to_string(task.start) + "-" + to_string(task.end);
+    return false;
+  }
+  return true;
+}
 
-  if (args.i) { //load from index
-    tick();
-    if (!loadData(dat, file, args.l))
-      return;
-    tock("loadData");
-    if (args.l) { //list index file contents and exit
-      printIndexInfo(dat);
+//map from region name to index within index file
+template <typename T> map<string, int64_t> nameIndex(ComplexityData<T> const &dat) {
+  map<string, int64_t> nameidx;
+  nameidx[""] = -1;
+  for (int64_t i=0; i<(int64_t)dat.labels.size(); i++)
+    nameidx[dat.labels[i]] = i;
+  return nameidx;
+}
+
+//tasks evaluated in parallel at once in batch mode, bounds the buffered output
+const size_t BATCH_BLOCK = 1 << 16;
+
+//batch mode: one value per task, blocks of tasks are evaluated in parallel
+//and their output (and messages) printed in task order
+template <typename T>
+void processBatch(ComplexityData<T> const &dat, map<string, int64_t> const &nameidx,
+                  vector<Task> &tasks) {
+  size_t bsz = min(BATCH_BLOCK, tasks.size());
+  vector<string> out(bsz), log(bsz);
+  MlNorm norm = mlNorm(dat); //shared by all tasks
+  int prec = resOut->precision();
+  tick();
+  for (size_t b = 0; b < tasks.size(); b += bsz) {
+    size_t m = min(bsz, tasks.size() - b);
+    parallelFor(m, args.threads, [&](unsigned, size_t from, size_t to) {
+      //buffers reused by all tasks of the chunk
+      vector<double> y(1);
+      OutBuf os(prec);
+      ostringstream es;
+      es.copyfmt(cerr);
+      for (size_t i = from; i < to; i++) {
+        Task &task = tasks[b + i];
+        os.clear();
+        es.str("");
+        string err;
+        if (checkTask(task, dat, nameidx, err)) {
+          auto iv = taskInterval(task, dat);
+          mlComplexity(iv.first, iv.second, iv.second, iv.second, y, dat, norm, es);
+          os.putUInt(task.num);
+          os.put('\t');
+          os.putFixed(y[0]);
+          os.put('\n');
+        } else
+          es << "ERROR in task #" << task.num << ": " << err << endl;
+        out[i] = os.str();
+        log[i] = es.str();
+      }
+    });
+    for (size_t i = 0; i < m; i++) {
+      if (!log[i].empty()) {
+        *resOut << flush;
+        cerr << log[i];
+      }
+      *resOut << out[i];
+    }
+    *resOut << flush;
+  }
+  tock("batch");
+}
+
+//window sizes grouped by interval (0: default interval)
+vector<pair<vector<size_t>, size_t>> windowGroups() {
+  vector<pair<vector<size_t>, size_t>> grps;
+  if (args.k.size() <= 1) {
+    grps.push_back(make_pair(vector<size_t>(args.w.begin(), args.w.end()),
+                             args.k.empty() ? 0 : args.k[0]));
+    return grps;
+  }
+  for (size_t i = 0; i < args.w.size(); i++) {
+    auto it = find_if(grps.begin(), grps.end(), [&](pair<vector<size_t>, size_t> const &g) {
+      return g.second == args.k[i];
+    });
+    if (it == grps.end())
+      it = grps.insert(grps.end(), make_pair(vector<size_t>(), args.k[i]));
+    it->first.push_back(args.w[i]);
+  }
+  return grps;
+}
+
+//show results for all tasks
+template <typename T> void processData(ComplexityData<T> &dat) {
+  auto nameidx = nameIndex(dat);
+  vector<Task> tasks = args.tasks; //resolved for this file
+  if (tasks.size() > 1 && !args.p) {
+    processBatch(dat, nameidx, tasks);
+    return;
+  }
+  for (auto &task : tasks) {
+    string err;
+    if (!checkTask(task, dat, nameidx, err)) {
+      cerr << "ERROR in task #" << task.num << ": " << err << endl;
+      continue;
+    }
+
+    //window sizes with the same interval are one table, the tables are
+    //separated by two empty lines
+    auto grps = windowGroups();
+    for (size_t i = 0; i < grps.size(); i++) {
+      auto ys = calcComplexities(grps[i].first, grps[i].second, task, dat);
+      if (args.p)
+        continue;
+      if (i > 0 && args.o == OutFormat::Text)
+        *resOut << "\n\n";
+      printResults(task, dat.labels, dat.regions, grps[i].first, grps[i].second, ys, args.g);
+    }
+  }
+}
+
+//load data from index file
+template <typename T> void processIndex(char const *file) {
+  ComplexityData<T> dat;
+  tick();
+  //the tasks only need the part of the index covering their intervals
+  size_t from = 0, to = SIZE_MAX;
+  if (!args.l) {
+    ComplexityData<T> info;
+    if (!loadData(info, file, true))
       return;
+    auto nameidx = nameIndex(info);
+    from = SIZE_MAX;
+    to = 0;
+    for (auto task : args.tasks) {
+      string err; //reported by processData
+      if (!checkTask(task, info, nameidx, err))
+        continue;
+      auto iv = taskInterval(task, info);
+      from = min(from, iv.first);
+      to = max(to, iv.first + iv.second);
     }
+    from = min(from, to);
+  }
+  if (!loadData(dat, file, args.l, from, to))
+    return;
+  tock("loadData");
+  if (args.l) { //list index file contents and exit
+    printIndexInfo(dat);
+    return;
+  }
+  processData(dat);
+}
+
+//extract data from parsed fasta file, with -s save it to idxfile (stdout if null)
+template <typename T> void processFasta(FastaFile &ff, char const *idxfile) {
+  ComplexityData<T> dat;
+  extractData(dat, ff);
+
+  if (args.s && !args.p) { // just dump intermediate results and quit
+    if (!saveData(dat, idxfile, args.z))
+      cerr << "ERROR: Could not write index file " << idxfile << "!" << endl;
+    return;
+  }
+  processData(dat);
+}
+
+//load / extract data, show results
+void processFile(char const *file, char const *idxfile = nullptr) {
+  //infer whether given file is an index (user can forget -i)
+  bool isIdx = args.i || (file && with_file_in(file, readMagic));
+
+  //the index type is chosen by the length of the text seq$revseq$
+  if (isIdx) { //load from index
+    size_t len;
+    if (!loadLength(len, file))
+      return;
+    if (fitsIdx32(2 * len + 2))
+      processIndex<uint32_t>(file);
+    else if (fitsIdx64(2 * len + 2))
+      processIndex<uint64_t>(file);
+    else
+      cerr << "ERROR: Sequence too long for this build!" << endl;
   } else { // not loading from pre-computed data -> fasta file
     tick();
-    FastaFile ff(file);
+    FastaFile ff(file, true, args.threads);
     tock("readFastaFromFile");
     if (ff.failed) {
       cerr << "Invalid FASTA file!" << endl;
@@ -111,55 +361,60 @@ void processFile(char const *file) {
       cerr << "Headers of the FASTA sequence must be unique before the first whitespace or 32 characters!" << endl;
       return;
     }
-    extractData(dat, ff);
-
-    if (args.s && !args.p) { // just dump intermediate results and quit
-      saveData(dat, nullptr);
-      return;
-    }
+    size_t len = ff.len;
+    if (fitsIdx32(2 * len + 2))
+      processFasta<uint32_t>(ff, idxfile);
+    else if (fitsIdx64(2 * len + 2))
+      processFasta<uint64_t>(ff, idxfile);
+    else
+      cerr << "ERROR: Sequence too long for this build!" << endl;
   }
+}
 
-  //map from region name to index within index file
-  map<string, int64_t> nameidx;
-  nameidx[""] = -1;
-  for (int64_t i=0; i<(int64_t)dat.labels.size(); i++)
-    nameidx[dat.labels[i]] = i;
-
-  for (auto &task : args.tasks) {
-    string errstr = "ERROR in task #" + to_string(task.num) + ": ";
+//bytes per base of a sequence processed in memory (text, suffix array and LCP
+//of both strands) and with -m (text and buffers)
+const size_t MEM_PER_BASE = 20, EXT_MEM_PER_BASE = 4;
 
-    //get index of region if not global adressing
-    if (task.lbl != "") {
-      if (nameidx.find(task.lbl) == nameidx.end()) {
-        cerr << errstr << "Invalid sequence name: " << task.lbl << endl;
-        continue;
-      }
-      task.idx = nameidx[task.lbl];
-    }
-    //sanity check for manually set index values
-    if (task.idx < -1 || task.idx >= (int64_t)dat.regions.size()) {
-      cerr << errstr << "Invalid sequence index (" << task.idx << ") for name " << task.lbl << endl;
-      continue;
-    }
+//rough peak memory of processing a file, index files are mapped
+size_t memoryEstimate(char const *file) {
+  struct stat st;
+  if (args.i || with_file_in(file, readMagic))
+    return stat(file, &st) == 0 ? st.st_size : 0;
+  size_t len = estimateLength(file);
+  return args.m ? EXT_MEM_PER_BASE * len + (args.m << 20) : MEM_PER_BASE * len;
+}
 
-    size_t reglen = task.idx >= 0 ? dat.regions[task.idx].second : dat.len;
-    if ((task.start!=0 || task.end!=0) && (task.start > task.end || task.start >= reglen ||
-        task.end-task.start+1 > reglen - task.start)) {
-      cerr << errstr << "Invalid range: " << task.start << "-" << task.end << endl;
-      continue;
-    }
+//several files: processed by a pool of -j workers that starts no file while
+//the estimated memory would exceed -M, the results are printed in the order
+//of the files, each after a line with its name. Indices go to FILE.idx.
+void processFiles() {
+  size_t n = args.num_files, printed = 0;
+  vector<size_t> cost(n);
+  for (size_t i = 0; i < n; i++)
+    cost[i] = memoryEstimate(args.files[i]);
+  vector<string> res(n);
+  vector<bool> done(n, false);
+  mutex mtx;
+  jobPool(cost, args.maxmem << 20, args.jobs, [&](size_t i) {
+    char const *file = args.files[i];
+    string idxfile = string(file) + ".idx";
+    ostringstream os;
+    os.copyfmt(cout);
+    if (args.jobs > 1) //buffered until the files before are printed
+      resOut = &os;
+    if (!args.s)
+      *resOut << "# " << file << "\n";
+    processFile(file, idxfile.c_str());
+    resOut = &cout;
 
-    size_t w = args.w;
-    size_t k = args.k;
-    auto ys = calcComplexities(w, k, task, dat);
-    if (!args.p) {
-      if (args.tasks.size()==1) {
-        printResults(task, dat.labels, dat.regions, w, k, ys, args.g);
-      } else {
-        cout << task.num << "\t" << ys[0].second[0] << endl;
-      }
+    lock_guard<mutex> lock(mtx);
+    res[i] = os.str();
+    done[i] = true;
+    for (; printed < n && done[printed]; printed++) {
+      cout << res[printed] << flush;
+      string().swap(res[printed]);
     }
-  }
+  });
 }
 
 int main(int argc, char *argv[]) {
@@ -178,7 +433,9 @@ int main(int argc, char *argv[]) {
   tick();
   if (args.num_files == 0)
     processFile(nullptr); //from stdin
-  else
+  else if (args.num_files == 1)
     processFile(args.files[0]);
+  else
+    processFiles();
   tock("total time");
 }
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Array that either owns its values or borrows them read-only from memory
+// kept alive by a shared handle (e.g. a memory mapped index file). Writing
+// to a borrowed array first copies it.
+template <typename T> class MappedVec {
+public:
+  typedef T value_type;
+  typedef T const *const_iterator;
+  typedef T *iterator;
+
+  MappedVec() {}
+  explicit MappedVec(size_t m) : own(m) { sync(); }
+  explicit MappedVec(std::vector<T> v) : own(std::move(v)) { sync(); }
+  MappedVec(MappedVec const &o) : own(o.own), keep(o.keep) {
+    if (keep) {
+      ptr = o.ptr;
+      n = o.n;
+    } else
+      sync();
+  }
+  MappedVec(MappedVec &&o) { swap(o); }
+  MappedVec &operator=(MappedVec o) {
+    swap(o);
+    return *this;
+  }
+
+  // use m values at p as long as owner is alive
+  static MappedVec borrow(T const *p, size_t m, std::shared_ptr<void const> owner) {
+    MappedVec v;
+    v.ptr = const_cast<T *>(p);
+    v.n = m;
+    v.keep = std::move(owner);
+    return v;
+  }
+  bool borrowed() const { return (bool)keep; }
+
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  T const *data() const { return ptr; }
+  T const &operator[](size_t i) const { return ptr[i]; }
+  T &operator[](size_t i) {
+    detach();
+    return ptr[i];
+  }
+  T const &front() const { return ptr[0]; }
+  T const &back() const { return ptr[n - 1]; }
+  const_iterator begin() const { return ptr; }
+  const_iterator end() const { return ptr + n; }
+
+  void resize(size_t m) {
+    detach();
+    own.resize(m);
+    sync();
+  }
+  void push_back(T const &x) {
+    detach();
+    own.push_back(x);
+    sync();
+  }
+  void clear() { *this = MappedVec(); }
+
+  void swap(MappedVec &o) {
+    own.swap(o.own);
+    keep.swap(o.keep);
+    std::swap(ptr, o.ptr);
+    std::swap(n, o.n);
+  }
+
+private:
+  void sync() {
+    ptr = own.data();
+    n = own.size();
+  }
+  void detach() {
+    if (!keep)
+      return;
+    own.assign(ptr, ptr + n);
+    keep.reset();
+    sync();
+  }
+
+  std::vector<T> own;
+  std::shared_ptr<void const> keep; // owner of borrowed memory
+  T *ptr = nullptr;
+  size_t n = 0;
+};
@@ -4,6 +4,7 @@
  * Date: Wed Jul 15 10:49:56 2015
  **************************************************/
 #include "matchlength.h"
+#include "parallel.h"
 #include "shulen.h"
 #include <algorithm>
 #include <vector>
@@ -11,7 +12,7 @@
 #include <sstream>
 using namespace std;
 
-void Fact::print() const {
+template <typename T> void Fact<T>::print() const {
   stringstream ss;
   size_t n = fact.size();
   for (size_t i = 0; i < n; i++) {
@@ -25,8 +26,8 @@ void Fact::print() const {
 }
 
 // length of factor
-size_t Fact::factLen(size_t i) const {
-  Fact const &f = *this;
+template <typename T> size_t Fact<T>::factLen(size_t i) const {
+  Fact<T> const &f = *this;
   if (i == 0)
     return f.fact[1];
   if (i == f.fact.size() - 1)
@@ -35,7 +36,7 @@ size_t Fact::factLen(size_t i) const {
 }
 
 //input: esa for both strands (seq$revcompseq$)
-void computeMLFact(Fact &mlf, Esa const &esa) {
+template <typename T> void computeMLFact(Fact<T> &mlf, Esa<T> const &esa) {
   mlf.fact.resize(0);
   mlf.str = esa.str;
   mlf.strLen = esa.n/2; //single strand length
@@ -43,7 +44,7 @@ void computeMLFact(Fact &mlf, Esa const &esa) {
   /* construct and fill array of match lengths */
   vector<uint64_t> ml(esa.n);
   for (size_t i = 0; i < esa.n; i++) {
-    ml[esa.sa[i]] = max(1UL, (size_t)max(esa.lcp[i], esa.lcp[i + 1]));
+    ml[esa.sa[i]] = max(1UL, (size_t)esa.lcp.max2(i));
   }
 
   /* compute observed number of match factors, store their positions */
@@ -57,7 +58,65 @@ void computeMLFact(Fact &mlf, Esa const &esa) {
   mlf.fact.resize(factmp.size());
   for (i=0; i<factmp.size(); i++)
     mlf.fact[i] = factmp[i];
-#ifdef USE_SDSL
-    sdsl::util::bit_compress(mlf.fact);
-#endif
+  bitCompress(mlf.fact);
 }
+
+// input: seq$revcompseq$ and its suffix array, which is consumed.
+// The match length of p is the larger LCP with its lexicographic neighbours,
+// max(plcp[p], plcp[next[p]]). It is only evaluated at factor starts while
+// walking the first strand in text order, so no match length array is needed.
+template <typename T>
+void computeMLFactPlcp(Fact<T> &mlf, char const *str, size_t n, idx_vec<T> &&sa,
+                       unsigned threads) {
+  mlf.fact.resize(0);
+  mlf.str = str;
+  mlf.strLen = n/2; //single strand length
+  unsigned wt = writeThreads<idx_vec<T>>(threads);
+
+  /* Phi array (previous suffix), then drop the suffix array */
+  idx_vec<T> plcp(n);
+  parallelFor(n, wt, [&](unsigned, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+      plcp[sa[i]] = i ? (size_t)sa[i - 1] : n;
+  });
+  idx_vec<T>().swap(sa);
+
+  /* inverse of Phi (next suffix), n marks the last one */
+  idx_vec<T> next(n);
+  parallelFor(n, wt, [&](unsigned, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+      next[i] = n;
+  });
+  parallelFor(n, wt, [&](unsigned, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+      if ((size_t)plcp[i] != n)
+        next[plcp[i]] = i;
+  });
+
+  calcPlcp(plcp, str, n, threads);
+
+  /* walk the factors, storing their positions */
+  vector<size_t> factmp;
+  size_t i = 0;
+  while (i < mlf.strLen) {
+    factmp.push_back(i);
+    size_t ml = plcp[i];
+    if ((size_t)next[i] != n)
+      ml = max(ml, (size_t)plcp[next[i]]);
+    i += max((size_t)1, ml);
+  }
+
+  mlf.fact.resize(factmp.size());
+  for (i=0; i<factmp.size(); i++)
+    mlf.fact[i] = factmp[i];
+  bitCompress(mlf.fact);
+}
+
+template struct Fact<uint32_t>;
+template struct Fact<uint64_t>;
+template void computeMLFact(Fact<uint32_t> &mlf, Esa<uint32_t> const &esa);
+template void computeMLFact(Fact<uint64_t> &mlf, Esa<uint64_t> const &esa);
+template void computeMLFactPlcp(Fact<uint32_t> &mlf, char const *str, size_t n,
+                                idx_vec<uint32_t> &&sa, unsigned threads);
+template void computeMLFactPlcp(Fact<uint64_t> &mlf, char const *str, size_t n,
+                                idx_vec<uint64_t> &&sa, unsigned threads);
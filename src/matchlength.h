@@ -6,16 +6,19 @@
 #include "config.h"
 #include "esa.h"
 
-/* a match-length factorization of a string */
-struct Fact {
+/* a match-length factorization of a string, T is the index type */
+template <typename T = uint64_t> struct Fact {
   void print() const;
   size_t factLen(size_t i) const;
 
-  uint_vec fact;     /* positions of factors */
+  idx_vec<T> fact;     /* positions of factors */
 
   char const *str; /* string */
   size_t strLen;   /* string length */
 };
 
 
-void computeMLFact(Fact &fact, Esa const &esa);
+template <typename T> void computeMLFact(Fact<T> &fact, Esa<T> const &esa);
+template <typename T>
+void computeMLFactPlcp(Fact<T> &fact, char const *str, size_t n, idx_vec<T> &&sa,
+                       unsigned threads = 1);
@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+using namespace std;
+
+#include "output.h"
+
+OutBuf::OutBuf(int precision) : prec(precision), scale(0) {
+  if (prec >= 0 && prec <= 9) {
+    scale = 1;
+    for (int i = 0; i < prec; i++)
+      scale *= 10;
+  }
+}
+
+void OutBuf::putUInt(uint64_t x) {
+  char tmp[20];
+  size_t n = 0;
+  do {
+    tmp[n++] = '0' + x % 10;
+    x /= 10;
+  } while (x);
+  while (n)
+    buf.push_back(tmp[--n]);
+}
+
+void OutBuf::putFixed(double x) {
+  // x * 10^prec is exact enough to round it unless it is (almost) halfway
+  // between two outputs or too big, then printf does the exact rounding
+  double v = fabs(x) * (double)scale;
+  double fl = floor(v);
+  if (scale && v < 1e11 && fabs(v - fl - 0.5) > 1e-4) {
+    uint64_t u = (uint64_t)fl + (v - fl > 0.5);
+    if (signbit(x))
+      buf.push_back('-');
+    putUInt(u / scale);
+    if (prec == 0)
+      return;
+    buf.push_back('.');
+    uint64_t frac = u % scale;
+    size_t end = buf.size() + prec;
+    buf.resize(end);
+    for (int i = 1; i <= prec; i++, frac /= 10)
+      buf[end - i] = '0' + frac % 10;
+    return;
+  }
+  char tmp[64];
+  int n = snprintf(tmp, sizeof(tmp), "%.*f", prec, x);
+  if (n < (int)sizeof(tmp)) {
+    buf.append(tmp, n);
+    return;
+  }
+  vector<char> big(n + 1);
+  snprintf(big.data(), big.size(), "%.*f", prec, x);
+  buf.append(big.data(), n);
+}
+
+void OutBuf::writeTo(ostream &o) {
+  o.write(buf.data(), buf.size());
+  buf.clear();
+}
+
+void writeBedGraph(ostream &o, ResultMat const &ys, vector<TrackSeq> const &seqs, size_t k,
+                   int precision) {
+  OutBuf os(precision), val(precision), last(precision); // last: value of the run
+  for (auto &col : ys) {
+    os.put("track type=bedGraph name=\"" + col.first + "\"\n");
+    for (auto &sq : seqs) {
+      // interval of row j is [center - k/2, center - k/2 + k) within the sequence
+      size_t beg = 0, end = 0; // current run of equal values, empty if beg == end
+      auto endRun = [&]() {
+        if (end > beg) {
+          os.put(sq.name);
+          os.put('\t');
+          os.putUInt(beg);
+          os.put('\t');
+          os.putUInt(end);
+          os.put('\t');
+          os.put(last.str());
+          os.put('\n');
+        }
+        beg = end;
+      };
+      for (size_t j = 0; j < sq.rows; j++) {
+        double y = col.second[sq.first + j];
+        size_t c = sq.center + j * k, l = c >= k / 2 ? c - k / 2 : 0, r = min(sq.len, c + k - k / 2);
+        if (y < 0) { // bad windows are gaps
+          endRun();
+          continue;
+        }
+        val.clear();
+        val.putFixed(y);
+        if (end == beg || l != end || val.str() != last.str()) {
+          endRun();
+          beg = l;
+          swap(val, last);
+        }
+        end = r;
+      }
+      endRun();
+      if (os.size() > (1 << 20))
+        os.writeTo(o);
+    }
+  }
+  os.writeTo(o);
+}
+
+/* Track files (-o binary, -o zoom): a header, an offset table and the data
+ * of each sequence and level, all in the byte order of the writing machine.
+ * The header is "MACLETRK", a byte order mark (64 bit), the number of
+ * columns and of zoom levels L (32 bit each), the window interval and the
+ * number of sequences (64 bit each), then for each column the window size
+ * (64 bit) and the name, for each sequence the length, number of rows and
+ * first window center (64 bit each) and the name. Names are a 32 bit length
+ * followed by the characters. After padding to 8 bytes follow the 64 bit
+ * offsets of the data of every sequence for level 0..L. Level 0 has the
+ * values row by row as float32 (-1 for bad windows), level l > 0 has a
+ * ZoomBin for each column and bin of ZOOM^l rows. Levels are added until
+ * the longest sequence fits into one bin.
+ */
+const string trackMagic = "MACLETRK";
+const uint64_t TRACK_BYTE_ORDER_MARK = 0x0102030405060708ULL;
+
+template <typename T> static void binput(string &s, T x) {
+  s.append(reinterpret_cast<char const *>(&x), sizeof(x));
+}
+static void nameput(string &s, string const &name) {
+  binput(s, (uint32_t)name.size());
+  s += name;
+}
+
+static ZoomBin const emptyBin = {numeric_limits<float>::quiet_NaN(),
+                                  numeric_limits<float>::quiet_NaN(), 0, 0};
+
+// add the valid values summarized by x to z, sum is kept separately
+static void addBin(ZoomBin &z, double &sum, ZoomBin const &x) {
+  if (!x.valid)
+    return;
+  z.min = z.valid ? min(z.min, x.min) : x.min;
+  z.max = z.valid ? max(z.max, x.max) : x.max;
+  z.valid += x.valid;
+  sum += x.sum;
+}
+
+// bins of n values or bins of the level below, ZOOM of them each, get(i, c)
+// returns value or bin i of column c
+template <typename F> static vector<ZoomBin> zoomUp(size_t n, size_t cols, F get) {
+  vector<ZoomBin> ret;
+  for (size_t b = 0; b < n; b += ZOOM)
+    for (size_t c = 0; c < cols; c++) {
+      ZoomBin z = emptyBin;
+      double sum = 0;
+      for (size_t i = b; i < min(n, b + ZOOM); i++)
+        addBin(z, sum, get(i, c));
+      z.sum = sum;
+      ret.push_back(z);
+    }
+  return ret;
+}
+
+static size_t numBinsOf(size_t rows, size_t level) {
+  size_t b = 1;
+  for (size_t l = 0; l < level; l++)
+    b *= ZOOM;
+  return (rows + b - 1) / b;
+}
+
+void writeTrack(ostream &o, ResultMat const &ys, vector<size_t> const &ws,
+                vector<TrackSeq> const &seqs, size_t k, bool zoom) {
+  size_t cols = ys.size(), maxrows = 0;
+  for (auto &sq : seqs)
+    maxrows = max(maxrows, sq.rows);
+  uint32_t levels = 0;
+  while (zoom && numBinsOf(maxrows, levels) > 1)
+    levels++;
+
+  string head = trackMagic;
+  binput(head, TRACK_BYTE_ORDER_MARK);
+  binput(head, (uint32_t)cols);
+  binput(head, levels);
+  binput(head, (uint64_t)k);
+  binput(head, (uint64_t)seqs.size());
+  for (size_t c = 0; c < cols; c++) {
+    binput(head, (uint64_t)ws[c]);
+    nameput(head, ys[c].first);
+  }
+  for (auto &sq : seqs) {
+    binput(head, (uint64_t)sq.len);
+    binput(head, (uint64_t)sq.rows);
+    binput(head, (uint64_t)sq.center);
+    nameput(head, sq.name);
+  }
+  head.resize((head.size() + 7) / 8 * 8, '\0');
+  uint64_t off = head.size() + 8 * seqs.size() * (levels + 1);
+  for (auto &sq : seqs)
+    for (size_t l = 0; l <= levels; l++) {
+      binput(head, off);
+      off += l ? numBinsOf(sq.rows, l) * cols * sizeof(ZoomBin) : sq.rows * cols * sizeof(float);
+    }
+  o.write(head.data(), head.size());
+
+  string buf;
+  for (auto &sq : seqs) {
+    for (size_t j = 0; j < sq.rows; j++) {
+      for (size_t c = 0; c < cols; c++)
+        binput(buf, (float)ys[c].second[sq.first + j]);
+      if (buf.size() > (1 << 20)) {
+        o.write(buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+    o.write(buf.data(), buf.size());
+    buf.clear();
+    vector<ZoomBin> bins; // of the current level
+    for (size_t l = 1; l <= levels; l++) {
+      if (l == 1)
+        bins = zoomUp(sq.rows, cols, [&](size_t i, size_t c) {
+          float y = ys[c].second[sq.first + i];
+          return y < 0 ? emptyBin : ZoomBin{y, y, y, 1};
+        });
+      else
+        bins = zoomUp(bins.size() / cols, cols, [&](size_t i, size_t c) { return bins[i * cols + c]; });
+      o.write(reinterpret_cast<char const *>(bins.data()), bins.size() * sizeof(ZoomBin));
+    }
+  }
+  o.flush();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "complexity.h" //ResultMat
+
+// Text output buffer with fast number formatting. Chunks of a result can be
+// formatted into separate buffers concurrently and written in order, so
+// nothing is flushed per line.
+class OutBuf {
+public:
+  explicit OutBuf(int precision = 4);
+
+  void put(char c) { buf.push_back(c); }
+  void put(std::string const &s) { buf.append(s); }
+  void putUInt(uint64_t x);
+  // same digits as printf("%.*f", precision, x) or std::fixed
+  void putFixed(double x);
+
+  size_t size() const { return buf.size(); }
+  std::string const &str() const { return buf; }
+  void clear() { buf.clear(); }
+  // write the buffered text to o and clear the buffer
+  void writeTo(std::ostream &o);
+
+private:
+  int prec;
+  uint64_t scale; // 10^prec if prec is small enough for the fast path
+  std::string buf;
+};
+
+// rows of a result table that belong to one sequence, the windows of the
+// rows are centered at center, center+k, ...
+struct TrackSeq {
+  std::string name;
+  size_t len;    // sequence length
+  size_t first;  // first row
+  size_t rows;   // number of rows
+  size_t center; // window center of the first row in the sequence
+};
+
+// one bedGraph track per column of ys with intervals of k bases around the
+// window centers, equal neighbouring values (after rounding to precision)
+// are merged and bad windows (-1) are left out
+void writeBedGraph(std::ostream &o, ResultMat const &ys, std::vector<TrackSeq> const &seqs,
+                   size_t k, int precision);
+
+// factor between the bin sizes of neighbouring zoom levels
+const size_t ZOOM = 4;
+
+// track file with the values of ys as float32, with zoom levels if zoom is set
+void writeTrack(std::ostream &o, ResultMat const &ys, std::vector<size_t> const &ws,
+                std::vector<TrackSeq> const &seqs, size_t k, bool zoom);
+
+// summary of the valid values of a column in a bin of a zoom level
+struct ZoomBin {
+  float min, max, sum; // NaN, NaN, 0 without valid values
+  uint32_t valid;      // number of valid values
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+// Array of unsigned integers with 40 bits (5 bytes) per entry, enough for
+// indices into texts of up to 2^40 characters. An entry only touches its own
+// 5 bytes, so distinct entries can be read and written concurrently.
+class Packed40Vec {
+public:
+  typedef uint64_t value_type;
+  static const uint64_t MAX = (1ULL << 40) - 1;
+
+  // reference to a single entry
+  class Ref {
+  public:
+    Ref(uint8_t *p) : ptr(p) {}
+    operator uint64_t() const { return load(ptr); }
+    Ref &operator=(uint64_t x) {
+      store(ptr, x);
+      return *this;
+    }
+    Ref &operator=(Ref const &r) { return *this = (uint64_t)r; }
+
+  private:
+    uint8_t *ptr;
+  };
+
+  // iterator for fast sequential reading
+  class const_iterator {
+  public:
+    const_iterator(uint8_t const *p) : ptr(p) {}
+    uint64_t operator*() const { return load(ptr); }
+    const_iterator &operator++() {
+      ptr += 5;
+      return *this;
+    }
+    bool operator==(const_iterator const &o) const { return ptr == o.ptr; }
+    bool operator!=(const_iterator const &o) const { return ptr != o.ptr; }
+
+  private:
+    uint8_t const *ptr;
+  };
+
+  Packed40Vec() {}
+  explicit Packed40Vec(size_t m) { resize(m); }
+  Packed40Vec(Packed40Vec const &o) {
+    resize(o.n);
+    if (n)
+      memcpy(dat, o.dat, bytes(n));
+  }
+  Packed40Vec(Packed40Vec &&o) { swap(o); }
+  Packed40Vec &operator=(Packed40Vec o) {
+    swap(o);
+    return *this;
+  }
+  ~Packed40Vec() { free(dat); }
+
+  size_t size() const { return n; }
+  uint64_t operator[](size_t i) const { return load(dat + 5 * i); }
+  Ref operator[](size_t i) { return Ref(dat + 5 * i); }
+  const_iterator begin() const { return const_iterator(dat); }
+  const_iterator end() const { return const_iterator(dat + 5 * n); }
+
+  // resize, new entries are 0
+  void resize(size_t m) {
+    if (m == n)
+      return;
+    if (m == 0) {
+      free(dat);
+      dat = nullptr;
+      n = 0;
+      return;
+    }
+    uint8_t *neu = (uint8_t *)realloc(dat, bytes(m));
+    if (!neu)
+      throw std::bad_alloc();
+    if (m > n)
+      memset(neu + 5 * n, 0, bytes(m) - 5 * n);
+    dat = neu;
+    n = m;
+  }
+
+  void swap(Packed40Vec &o) {
+    std::swap(dat, o.dat);
+    std::swap(n, o.n);
+  }
+
+  // take ownership of a malloc'd array of m 64 bit values (each <= MAX) and
+  // pack it in place. Entry i moves from byte 8i to 5i, so reading forward
+  // never overwrites unread values. The buffer is shrunk afterwards.
+  void adopt(int64_t *buf, size_t m) {
+    if (m == 0) {
+      free(buf);
+      resize(0);
+      return;
+    }
+    uint8_t *b = (uint8_t *)buf;
+    for (size_t i = 0; i < m; i++) {
+      uint64_t x = (uint64_t)buf[i];
+      store(b + 5 * i, x);
+    }
+    uint8_t *neu = (uint8_t *)realloc(buf, bytes(m));
+    free(dat);
+    dat = neu ? neu : b;
+    n = m;
+  }
+
+private:
+  static size_t bytes(size_t m) { return 5 * m; }
+
+  static uint64_t load(uint8_t const *p) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t x = 0;
+    memcpy(&x, p, 5);
+    return x;
+#else
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+           (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32;
+#endif
+  }
+
+  static void store(uint8_t *p, uint64_t x) {
+    for (size_t j = 0; j < 5; j++)
+      p[j] = (uint8_t)(x >> (8 * j));
+  }
+
+  uint8_t *dat = nullptr;
+  size_t n = 0;
+};
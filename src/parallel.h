@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const size_t MIN_CHUNK = 1024; // smallest number of items worth a thread
+
+// number of chunks parallelFor splits n items into
+inline unsigned numChunks(size_t n, unsigned threads) {
+  return (unsigned)std::max((size_t)1, std::min((size_t)threads, n / MIN_CHUNK));
+}
+
+// split [0, n) into numChunks(n, threads) contiguous chunks and call
+// f(chunk, from, to) for each chunk in its own thread
+template <typename F> void parallelFor(size_t n, unsigned threads, F f) {
+  unsigned chunks = numChunks(n, threads);
+  if (chunks == 1) {
+    f(0U, (size_t)0, n);
+    return;
+  }
+  std::vector<std::thread> ts;
+  for (unsigned c = 0; c < chunks; c++)
+    ts.emplace_back(f, c, n * c / chunks, n * (c + 1) / chunks);
+  for (auto &t : ts)
+    t.join();
+}
+
+// call f(i) for the jobs i = 0, 1, ... (in this order) on at most workers
+// threads. Job i needs cost[i] of the budget and only starts when the running
+// jobs leave enough of it (or when no other job runs), so expensive jobs do
+// not run at the same time.
+template <typename F>
+void jobPool(std::vector<size_t> const &cost, size_t budget, unsigned workers, F f) {
+  size_t n = cost.size(), next = 0, used = 0;
+  unsigned running = 0;
+  std::mutex mtx;
+  std::condition_variable cv;
+  auto work = [&]() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      cv.wait(lock, [&] { return next == n || !running || used + cost[next] <= budget; });
+      if (next == n)
+        return;
+      size_t i = next++;
+      used += cost[i];
+      running++;
+      cv.notify_all(); // the next job may fit as well
+      lock.unlock();
+      f(i);
+      lock.lock();
+      used -= cost[i];
+      running--;
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> ts;
+  for (unsigned t = 1; t < std::min((size_t)workers, n); t++)
+    ts.emplace_back(work);
+  work();
+  for (auto &t : ts)
+    t.join();
+}
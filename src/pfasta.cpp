@@ -103,6 +103,8 @@ static inline size_t dynstr_len(const dynstr *ds);
 int pfasta_read_name(pfasta_file *pf, pfasta_seq *ps);
 int pfasta_read_comment(pfasta_file *pf, pfasta_seq *ps);
 int pfasta_read_seq(pfasta_file *pf, pfasta_seq *ps);
+static int pfasta_read_seq_into(pfasta_file *pf, dynstr *seq, int upper);
+static int pfasta_read_entry(pfasta_file *pf, pfasta_seq *ps, pfasta_buf *buf);
 
 /*
  * When reading from a buffer, basically three things can happen.
@@ -259,6 +261,30 @@ void pfasta_seq_free(pfasta_seq *ps) {
  * number on error.
  */
 int pfasta_read(pfasta_file *pf, pfasta_seq *ps) {
+  return pfasta_read_entry(pf, ps, NULL);
+}
+
+/** @brief Like `pfasta_read`, but the sequence data is converted to upper case
+ * and appended to `buf` instead of being returned in `ps->seq`. Its length is
+ * stored in `ps->len`. The buffer is grown with realloc if needed, so several
+ * sequences can be read into one buffer without further copies.
+ *
+ * @param pf - The parser to read from.
+ * @param ps - A reference to memory for the name and comment.
+ * @param buf - The buffer the sequence is appended to.
+ *
+ * @returns 0 if successful, 1 if the end of the file was reached and a negative
+ * number on error.
+ */
+int pfasta_read_into(pfasta_file *pf, pfasta_seq *ps, pfasta_buf *buf) {
+  assert(buf);
+  return pfasta_read_entry(pf, ps, buf);
+}
+
+/** @brief Reads name, comment and sequence of the next entry, the sequence
+ * into `ps` or, if given, appended to `buf`.
+ */
+static int pfasta_read_entry(pfasta_file *pf, pfasta_seq *ps, pfasta_buf *buf) {
   assert(pf && ps && pf->buffer);
   *ps = (pfasta_seq){NULL, NULL, NULL, 0};
   int return_code = 0;
@@ -276,7 +302,15 @@ int pfasta_read(pfasta_file *pf, pfasta_seq *ps) {
     if (pfasta_read_comment(pf, ps) < 0)
       PF_FAIL_FORWARD();
   }
-  if (pfasta_read_seq(pf, ps) < 0)
+  if (buf) {
+    size_t before = buf->len;
+    dynstr seq = {buf->str, buf->cap, buf->len};
+    int ret = pfasta_read_seq_into(pf, &seq, 1);
+    *buf = (pfasta_buf){seq.str, seq.count, seq.capacity};
+    if (ret < 0)
+      PF_FAIL_FORWARD();
+    ps->len = buf->len - before;
+  } else if (pfasta_read_seq(pf, ps) < 0)
     PF_FAIL_FORWARD();
 
   // Skip blank lines
@@ -375,6 +409,28 @@ int pfasta_read_seq(pfasta_file *pf, pfasta_seq *ps) {
   if (dynstr_init(&seq) != 0)
     PF_FAIL_ERRNO();
 
+  if (pfasta_read_seq_into(pf, &seq, 0) < 0)
+    PF_FAIL_FORWARD();
+  ps->len = dynstr_len(&seq);
+  ps->seq = dynstr_move(&seq);
+
+cleanup:
+  dynstr_free(&seq);
+  return return_code;
+}
+
+/** @brief Appends the sequence data to a dynamic string.
+ *
+ * @param pf - The parser used for reading.
+ * @param seq - The string the data is appended to (freed on allocation errors).
+ * @param upper - Convert the data to upper case?
+ *
+ * @returns 0 iff successful
+ */
+static int pfasta_read_seq_into(pfasta_file *pf, dynstr *seq, int upper) {
+  int return_code = 0;
+  size_t before = dynstr_len(seq);
+
   while (1) {
     // The only guaranty is !graph && !blank
     assert(!isgraph(buffer_peek(pf)) && !isblank(buffer_peek(pf)));
@@ -404,18 +460,16 @@ int pfasta_read_seq(pfasta_file *pf, pfasta_seq *ps) {
       if (!isgraph(c)) {
         PF_FAIL_STR("Unexpected character '%c' in sequence on line %zu", c, pf->line);
       }
-      if (dynstr_put(&seq, c) != 0)
+      if (dynstr_put(seq, upper ? toupper(c) : c) != 0)
         PF_FAIL_ERRNO();
     }
   }
 
-  if (dynstr_len(&seq) == 0) {
+  if (dynstr_len(seq) == before) {
     PF_FAIL_STR("Empty sequence on line %zu", pf->line);
   }
-  ps->seq = dynstr_move(&seq);
 
 cleanup:
-  dynstr_free(&seq);
   return return_code;
 }
 
@@ -23,10 +23,17 @@ typedef struct pfasta_seq {
   size_t len;
 } pfasta_seq;
 
+/** Growable buffer (allocated with malloc) sequences can be appended to. */
+typedef struct pfasta_buf {
+  char *str;
+  size_t len, cap;
+} pfasta_buf;
+
 int pfasta_parse(pfasta_file *, int file_descriptor);
 void pfasta_free(pfasta_file *);
 void pfasta_seq_free(pfasta_seq *);
 int pfasta_read(pfasta_file *, pfasta_seq *);
+int pfasta_read_into(pfasta_file *, pfasta_seq *, pfasta_buf *);
 
 const char *pfasta_strerror(const pfasta_file *);
 
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "mappedvec.h"
+
+// Bit vector with constant time rank: the number of set bits before every
+// superblock of 256 bits is stored in 64 bits, i.e. 1.25 bits per position.
+// Serialized as the number of positions (64 bit), then the words of the bit
+// vector and the superblock ranks. A bit vector can also cover only the
+// positions from some start on, then rank counts from that start (rounded
+// down to a superblock), which is enough for differences of ranks.
+class RankBitVec {
+public:
+  static const size_t SUPER = 256;              // bits per superblock
+  static const size_t WORDS = SUPER / 64;       // words per superblock
+
+  RankBitVec() {}
+  // bit vector of n positions with the bits at the positions of the sorted
+  // sequence v set, only positions [from, n) are stored (v has to be in it)
+  template <typename V>
+  RankBitVec(size_t n, V const &v, size_t from = 0) : len(n), first(from / SUPER * WORDS) {
+    std::vector<uint64_t> w((n + SUPER - 1) / SUPER * WORDS - first, 0);
+    for (size_t i = 0; i < v.size(); i++)
+      w[v[i] / 64 - first] |= 1ULL << (v[i] % 64);
+    std::vector<uint64_t> r(w.size() / WORDS + 1, 0);
+    for (size_t s = 0; s + 1 < r.size(); s++) {
+      r[s + 1] = r[s];
+      for (size_t j = 0; j < WORDS; j++)
+        r[s + 1] += __builtin_popcountll(w[s * WORDS + j]);
+    }
+    words = MappedVec<uint64_t>(std::move(w));
+    ranks = MappedVec<uint64_t>(std::move(r));
+  }
+
+  size_t size() const { return len; }
+  bool borrowed() const { return words.borrowed(); }
+  bool operator[](size_t i) const { return (words[i / 64 - first] >> (i % 64)) & 1; }
+
+  // number of set bits in [0, i) (from the start of the stored positions)
+  uint64_t rank(size_t i) const {
+    size_t w = i / 64 - first, s = w / WORDS;
+    uint64_t r = ranks[s];
+    for (size_t j = s * WORDS; j < w; j++)
+      r += __builtin_popcountll(words[j]);
+    if (i % 64)
+      r += __builtin_popcountll(words[w] << (64 - i % 64));
+    return r;
+  }
+
+  // call f(i) for the set positions i in increasing order
+  template <typename F> void eachSet(F f) const {
+    for (size_t j = 0; j < words.size(); j++)
+      for (uint64_t x = words[j]; x; x &= x - 1)
+        f((first + j) * 64 + __builtin_ctzll(x));
+  }
+
+  // number of bytes written by write()
+  size_t bytes() const { return 8 * (1 + words.size() + ranks.size()); }
+
+  // only for bit vectors of all positions
+  void write(std::ostream &o) const {
+    uint64_t n = len;
+    o.write(reinterpret_cast<char const *>(&n), sizeof(n));
+    o.write(reinterpret_cast<char const *>(words.data()), 8 * words.size());
+    o.write(reinterpret_cast<char const *>(ranks.data()), 8 * ranks.size());
+  }
+
+  // use a serialized RankBitVec of at most sz bytes at p (8 byte aligned)
+  // while owner is alive, returns false if it does not fit into sz bytes
+  static bool borrow(char const *p, size_t sz, std::shared_ptr<void const> owner,
+                     RankBitVec &v) {
+    uint64_t n;
+    if (sz < sizeof(n))
+      return false;
+    memcpy(&n, p, sizeof(n));
+    size_t nw = (n + SUPER - 1) / SUPER * WORDS, nr = nw / WORDS + 1;
+    if (n > 8 * sz || 8 * (1 + nw + nr) > sz)
+      return false;
+    uint64_t const *w = reinterpret_cast<uint64_t const *>(p) + 1;
+    v.len = n;
+    v.first = 0;
+    v.words = MappedVec<uint64_t>::borrow(w, nw, owner);
+    v.ranks = MappedVec<uint64_t>::borrow(w + nw, nr, owner);
+    return true;
+  }
+
+private:
+  size_t len = 0;
+  size_t first = 0;          // index of the first stored word
+  MappedVec<uint64_t> words; // bits, position i is bit i % 64 of word i / 64
+  MappedVec<uint64_t> ranks; // set bits before each superblock
+};
@@ -164,7 +164,7 @@ double binomial(int n, int k) {
     return b;
 }
 
-bool thresholdReached = false;
+thread_local bool thresholdReached = false;
 
 double sum(double x, double p, double l) {
   double s = 0;
@@ -14,8 +14,8 @@
 #include <fcntl.h>
 
 //for mmap stuff
-// #include <sys/mman.h>
-// #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "util.h"
 #include "args.h"
@@ -51,21 +51,32 @@ string randSeq(size_t n, string alphabet) {
 }
 
 // calculate the GC content
-double gcContent(string const &s) {
+double gcContent(string const &s) { return gcContent(s.data(), s.size()); }
+
+double gcContent(char const *s, size_t n) {
   size_t gc = 0;
   size_t at = 0;
-  for (auto c : s)
+  for (size_t i = 0; i < n; i++) {
+    char c = s[i];
     if (c == 'g' || c == 'G' || c == 'c' || c == 'C')
       gc++;
     else if (c == 'a' || c == 'A' || c == 't' || c == 'T')
       at++;
+  }
   return (double)gc/((double)gc+at);
 }
 
 // returns reverse complement DNA string
 string revComp(string const &s) {
-  string r = s;
-  for (char &c : r)
+  string r(s.size(), '\0');
+  revComp(s.data(), s.size(), &r[0]);
+  return r;
+}
+
+// writes reverse complement of s[0..n) to r (not overlapping with s)
+void revComp(char const *s, size_t n, char *r) {
+  for (size_t i = 0; i < n; i++) {
+    char c = s[n - 1 - i];
     switch (c) {
     case 'A':
       c = 'T';
@@ -80,8 +91,8 @@ string revComp(string const &s) {
       c = 'G';
       break;
     }
-  reverse(r.begin(), r.end());
-  return r;
+    r[i] = c;
+  }
 }
 
 std::string base_name(std::string const & path) {
@@ -142,32 +153,40 @@ bool with_file_out(char const *file, function<bool(ostream&)> lambda, ios_base::
   return with_file(file, lambda, ios_base::out|mode, &cout);
 }
 
-/*
-size_t getFilesize(const char* filename) {
-    struct stat st;
-    stat(filename, &st);
-    return st.st_size;
+MMapReader::~MMapReader() {
+  if (dat && munmap(const_cast<char *>(dat), sz) != 0)
+    cerr << "WARNING: Could not unmap memory!" << endl;
 }
-bool with_mmap(char const *file, function<bool(MMapReader&)> lambda) {
-  int fd = open_or_fail(file, O_RDONLY);
-
-  MMapReader r;
-  if (file)
-    r.sz=getFilesize(file);
-  char* data = reinterpret_cast<char*>(mmap(NULL, r.sz, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0));
-  if (data == MAP_FAILED) {
-    cerr << "ERROR: mmap failed! Can not continue processing file! Aborting!" << endl;
-    exit(EXIT_FAILURE);
-  }
-  r.dat = data;
-  bool ret = lambda(r);
-  int rc = munmap(data, r.sz);
-  if (rc != 0) {
-    cerr << "ERROR: Could not unmap memory! Aborting!" << endl;
-    exit(EXIT_FAILURE);
+
+// map file into memory, returns nullptr (after reporting) on failure
+shared_ptr<MMapReader> map_file(char const *file) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    cerr << "ERROR: Could not open file: " << file << endl;
+    return nullptr;
   }
+  auto r = map_fd(fd, file);
   close(fd);
-  return ret;
+  return r;
 }
-*/
 
+// map the file open as fd (named file in messages), the descriptor stays open
+shared_ptr<MMapReader> map_fd(int fd, char const *file) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    cerr << "ERROR: Could not stat file: " << file << endl;
+    return nullptr;
+  }
+  shared_ptr<MMapReader> r = make_shared<MMapReader>();
+  r->sz = st.st_size;
+  if (r->sz) {
+    void *data = mmap(NULL, r->sz, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      cerr << "ERROR: mmap failed for file: " << file << endl;
+      r->sz = 0;
+      return nullptr;
+    }
+    r->dat = reinterpret_cast<char const *>(data);
+  }
+  return r;
+}
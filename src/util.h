@@ -5,11 +5,14 @@
 #include <list>
 #include <functional>
 #include <iostream>
+#include <memory>
 
 std::string randSeq(size_t n, std::string alphabet = "ACGT");
 std::string randSeq(size_t n, double gc);
 double gcContent(std::string const &s);
+double gcContent(char const *s, size_t n);
 std::string revComp(std::string const &s);
+void revComp(char const *s, size_t n, char *r);
 
 std::string base_name(std::string const & path);
 int open_or_fail(char const *fname, int flag);
@@ -20,11 +23,14 @@ bool with_file(char const *file, std::function<bool(std::fstream&)> lambda, std:
 bool with_file_in(char const *file, std::function<bool(std::istream&)> lambda, std::ios_base::openmode mode=std::ios_base::in);
 bool with_file_out(char const *file, std::function<bool(std::ostream&)> lambda, std::ios_base::openmode mode=std::ios_base::out);
 
-/*
+// read-only memory mapping of a whole file, unmapped on destruction
 struct MMapReader {
-  char *dat=nullptr;
+  char const *dat=nullptr;
   size_t sz=0;
-  size_t off=0;
+  MMapReader() {}
+  MMapReader(MMapReader const &) = delete;
+  MMapReader &operator=(MMapReader const &) = delete;
+  ~MMapReader();
 };
-bool with_mmap(char const *file, std::function<bool(MMapReader&)> lambda);
-*/
+std::shared_ptr<MMapReader> map_file(char const *file);
+std::shared_ptr<MMapReader> map_fd(int fd, char const *file);
@@ -4,10 +4,12 @@
 #include <ctime>
 #include <algorithm>
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "fastafile.h"
 #include "esa.h"
+#include "packedvec.h"
 
 // some basic tests
 void test_getEsa() {
@@ -16,7 +18,7 @@ void test_getEsa() {
 
   char const *s = ff.seqs[0].seq.c_str();
   size_t n = ff.seqs[0].seq.size();
-  Esa esa(s, n); // calculate esa, including $
+  Esa<> esa(s, n); // calculate esa, including $
 
   mu_assert(esa.str == s, "ESA does not point to original sequence");
   mu_assert(esa.n == n, "ESA size not correct");
@@ -33,8 +35,8 @@ void test_reduceEsa() {
   string str = randSeq(1000);
   string str2n = str + "$" + revComp(str) + "$";
   str += "$";
-  Esa esaOne(str.c_str(), str.size());
-  Esa esaBoth(str2n.c_str(), str2n.size());
+  Esa<> esaOne(str.c_str(), str.size());
+  Esa<> esaBoth(str2n.c_str(), str2n.size());
   reduceEsa(esaBoth);
   esaBoth.str = str.c_str();
 
@@ -46,9 +48,121 @@ void test_reduceEsa() {
   }
 }
 
+// LCP via PLCP/Phi must equal the one computed by Kasai, without an ISA
+void test_lcpPhi() {
+  FastaFile ff("Data/hotspotExample2.fasta");
+  string str = ff.seqs[0].seq;
+  string rnd = randSeq(1000);
+  for (auto &s : {str + "$" + revComp(str) + "$", rnd + "$" + revComp(rnd) + "$"}) {
+    Esa<> esaKasai(s.c_str(), s.size());
+    Esa<> esaPhi(s.c_str(), s.size(), LcpAlgo::Phi);
+
+    mu_assert_eq(0UL, (size_t)esaPhi.isa.size(), "ISA computed with Phi");
+    mu_assert_eq(esaKasai.lcp.size(), esaPhi.lcp.size(), "LCP sizes differ");
+    for (size_t i = 0; i <= s.size(); i++)
+      mu_assert_eq(esaKasai.lcp[i], esaPhi.lcp[i], "LCP[" << i << "] does not match");
+  }
+}
+
+// 32 bit and 64 bit index types give the same arrays
+void test_esaIdx32() {
+  string str = randSeq(1000, "ACGTN");
+  str = str + "$" + revComp(str) + "$";
+  Esa<uint32_t> esa32(str.c_str(), str.size());
+  Esa<uint64_t> esa64(str.c_str(), str.size());
+  for (size_t i = 0; i < str.size(); i++) {
+    mu_assert_eq((uint64_t)esa32.sa[i], (uint64_t)esa64.sa[i], "SA[" << i << "] does not match");
+    mu_assert_eq((uint64_t)esa32.isa[i], (uint64_t)esa64.isa[i], "ISA[" << i << "] does not match");
+    mu_assert_eq((uint64_t)esa32.lcp[i], (uint64_t)esa64.lcp[i], "LCP[" << i << "] does not match");
+  }
+}
+
+// packed 40 bit array: access, in place packing of 64 bit values
+void test_packed40Vec() {
+  size_t n = 1000;
+  int64_t *buf = (int64_t *)malloc(n * sizeof(int64_t));
+  Packed40Vec v(n);
+  for (size_t i = 0; i < n; i++) {
+    buf[i] = (int64_t)(Packed40Vec::MAX - i * 1234567);
+    v[i] = buf[i];
+  }
+  Packed40Vec w;
+  w.adopt(buf, n);
+  mu_assert_eq(n, w.size(), "wrong size after adopt");
+  size_t i = 0;
+  for (auto x : w) {
+    mu_assert_eq((uint64_t)(Packed40Vec::MAX - i * 1234567), x, "wrong value at " << i);
+    mu_assert_eq(x, (uint64_t)v[i], "wrong value at " << i);
+    i++;
+  }
+  v.resize(2 * n);
+  mu_assert_eq((uint64_t)0, (uint64_t)v[2 * n - 1], "new entries not 0");
+  mu_assert_eq((uint64_t)Packed40Vec::MAX, (uint64_t)v[0], "value lost on resize");
+}
+
+// byte LCP array: small and large values, written in any order
+void test_byteLcp() {
+  size_t n = 1000;
+  vector<uint64_t> vals(n);
+  for (size_t i = 0; i < n; i++)
+    vals[i] = i % 3 ? i % 255 : i * 1000;
+  ByteLcp lcp(n);
+  for (size_t i = 0; i < n; i++) {
+    size_t j = (i * 7) % n; // permutation of 0..n-1
+    lcp[j] = (uint64_t)-1;
+    lcp[j] = vals[j];
+  }
+  lcp.finalize();
+  ByteLcp const &clcp = lcp;
+  for (size_t i = 0; i < n; i++) {
+    mu_assert_eq(vals[i], clcp[i], "wrong LCP value at " << i);
+    if (i + 1 < n)
+      mu_assert_eq(max(vals[i], vals[i + 1]), clcp.max2(i), "wrong max at " << i);
+  }
+}
+
+// LCPs above the byte range compared to naive computation
+void test_lcpLarge() {
+  string rep = randSeq(300);
+  string str = rep + rep + "A" + rep + "$";
+  for (auto algo : {LcpAlgo::Kasai, LcpAlgo::Phi}) {
+    Esa<> esa(str.c_str(), str.size(), algo);
+    mu_assert(esa.lcp.numLarge() > 0, "no large LCP values");
+    for (size_t i = 1; i < str.size(); i++) {
+      size_t l = 0;
+      while (str[esa.sa[i - 1] + l] == str[esa.sa[i] + l])
+        l++;
+      mu_assert_eq((uint64_t)l, (uint64_t)esa.lcp[i], "LCP[" << i << "] incorrect");
+    }
+  }
+}
+
+// arrays built with several threads equal the single threaded ones
+void test_esaThreads() {
+  string rep = randSeq(300);
+  string str = randSeq(20000, "ACGTN") + rep + rep + string(1000, 'N') + rep;
+  str = str + "$" + revComp(str) + "$";
+  for (auto algo : {LcpAlgo::Kasai, LcpAlgo::Phi}) {
+    Esa<> esa1(str.c_str(), str.size(), algo);
+    Esa<> esa4(str.c_str(), str.size(), algo, 4);
+    mu_assert_eq(esa1.lcp.numLarge(), esa4.lcp.numLarge(), "number of large LCPs differs");
+    for (size_t i = 0; i <= str.size(); i++)
+      mu_assert_eq(esa1.lcp[i], esa4.lcp[i], "LCP[" << i << "] does not match");
+    mu_assert_eq(esa1.isa.size(), esa4.isa.size(), "ISA sizes differ");
+    for (size_t i = 0; i < esa1.isa.size(); i++)
+      mu_assert_eq((uint64_t)esa1.isa[i], (uint64_t)esa4.isa[i], "ISA[" << i << "] does not match");
+  }
+}
+
 void all_tests() {
   srand(time(NULL));
   mu_run_test(test_getEsa);
   mu_run_test(test_reduceEsa);
+  mu_run_test(test_lcpPhi);
+  mu_run_test(test_esaIdx32);
+  mu_run_test(test_packed40Vec);
+  mu_run_test(test_byteLcp);
+  mu_run_test(test_lcpLarge);
+  mu_run_test(test_esaThreads);
 }
 RUN_TESTS(all_tests)
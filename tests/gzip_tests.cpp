@@ -0,0 +1,140 @@
+#include "minunit.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "fastafile.h"
+#include "gzip.h"
+#include "util.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+
+// deflate s with zlib, as gzip member (bits 31) or raw (bits -15)
+string deflateStr(string const &s, int bits) {
+  z_stream zs = {};
+  deflateInit2(&zs, 6, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY);
+  string out(deflateBound(&zs, s.size()) + 32, '\0');
+  zs.next_in = (Bytef *)s.data();
+  zs.avail_in = s.size();
+  zs.next_out = (Bytef *)&out[0];
+  zs.avail_out = out.size();
+  deflate(&zs, Z_FINISH);
+  out.resize(out.size() - zs.avail_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+void putLE(string &s, uint32_t x, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    s.push_back((char)(x >> (8 * i)));
+}
+
+// s as BGZF file with blocks of bs bytes and the empty end block
+string bgzf(string const &s, size_t bs) {
+  string out;
+  for (size_t i = 0; i <= s.size(); i += bs) {
+    string part = s.substr(i, bs), cdat = deflateStr(part, -15);
+    out += string("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+    putLE(out, cdat.size() + 25, 2);
+    out += cdat;
+    putLE(out, crc32(0, (Bytef const *)part.data(), part.size()), 4);
+    putLE(out, part.size(), 4);
+    if (part.empty())
+      break;
+  }
+  return out;
+}
+
+// gunzip into a string, the error message on failure
+static string gunzipStr(string const &z, string &out, unsigned threads = 1) {
+  char *buf;
+  size_t len;
+  string msg = gunzip(z.data(), z.size(), buf, len, threads);
+  out = buf ? string(buf, len) : "";
+  free(buf);
+  return msg;
+}
+#endif
+
+// plain, multi member and BGZF data decompress to the original
+void test_gunzip() {
+#ifdef USE_ZLIB
+  string s;
+  for (size_t i = 0; i < 20; i++)
+    s += ">s" + to_string(i) + "\n" + randSeq(10000) + "\n";
+  vector<string> zs = {deflateStr(s, 31),
+                       deflateStr(s.substr(0, 5000), 31) + deflateStr(s.substr(5000), 31),
+                       bgzf(s, 65280), bgzf(s, 1000)};
+  for (auto &z : zs)
+    for (unsigned threads : {1, 4}) {
+      mu_assert(isGzip(z.data(), z.size()), "gzip not detected!");
+      string out;
+      mu_assert_eq(string(""), gunzipStr(z, out, threads), "decompression failed!");
+      mu_assert(out == s, "wrong decompressed data!");
+    }
+  mu_assert(!isGzip(s.data(), s.size()), "FASTA detected as gzip!");
+
+  string out;
+  mu_assert(!gunzipStr(zs[0].substr(0, zs[0].size() / 2), out).empty(), "truncated gzip accepted!");
+  // the size field of the last member is too small, the buffer has to grow
+  string big;
+  for (size_t i = 0; i < 10; i++)
+    big += s;
+  mu_assert_eq(string(""), gunzipStr(deflateStr(big, 31) + deflateStr("", 31), out), "failed!");
+  mu_assert(out == big, "wrong data of grown buffer!");
+  // clear the final bit of the deflate data of a block in the middle
+  string bad = zs[3];
+  bad[bad.find(string("\x1f\x8b\x08\x04", 4), bad.size() / 2) + 18] ^= 1;
+  mu_assert(!gunzipStr(bad, out, 4).empty(), "corrupt BGZF accepted!");
+#endif
+}
+
+// a compressed FASTA file gives the same sequences as the plain file, and
+// the same message if it is malformed
+void test_gzipFasta() {
+#ifdef USE_ZLIB
+  string s;
+  mu_assert(with_file_in("Data/test.fasta", [&](istream &f) {
+              s.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+              return true;
+            }), "could not read FASTA!");
+  char const *name = "_tmp_test.fa", *gzname = "_tmp_test.fa.gz";
+  vector<string> inputs = {s, ">a\nACGT\nAC#GT\n", "ACGT\n", ">a\nACGT\n>\nACGT\n",
+                           ">a comment", ">a\nACGT\n\nACGT\n"};
+  for (auto const &in : inputs)
+    for (bool concat : {false, true})
+      for (string const &z : {deflateStr(in, 31), bgzf(in, 100)}) {
+        {
+          ofstream f(name, ios::binary), fz(gzname, ios::binary);
+          f << in;
+          fz << z;
+        }
+        FastaFile ff(name, concat), ffz(gzname, concat, 2);
+        mu_assert_eq(ff.failed, ffz.failed, "failure differs for \"" << in << "\"");
+        mu_assert_eq(ff.error, ffz.error, "message differs for \"" << in << "\"");
+        mu_assert_eq(string(gzname), ffz.filename, "wrong file name!");
+        mu_assert_eq(ff.seqs.size(), ffz.seqs.size(), "wrong number of sequences!");
+        for (size_t i = 0; i < ff.seqs.size(); i++) {
+          mu_assert_eq(ff.seqs[i].name, ffz.seqs[i].name, "wrong name!");
+          mu_assert_eq(ff.seqs[i].seq, ffz.seqs[i].seq, "wrong sequence!");
+        }
+        mu_assert(ff.regions == ffz.regions, "wrong regions!");
+        mu_assert_eq(ff.len, ffz.len, "wrong length!");
+        if (concat && !ff.failed)
+          mu_assert_eq(string(ff.text.get(), ff.len), string(ffz.text.get(), ffz.len),
+                       "wrong text!");
+      }
+  remove(name);
+  remove(gzname);
+#endif
+}
+
+void all_tests() {
+  mu_run_test(test_gunzip);
+  mu_run_test(test_gzipFasta);
+}
+RUN_TESTS(all_tests)
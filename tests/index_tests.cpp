@@ -1,10 +1,22 @@
 #include "minunit.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
 using namespace std;
 
+#include "complexity.h"
+#include "deltavec.h"
 #include "index.h"
+#include "util.h"
 
-void assert_dataEqual(ComplexityData const &c1, ComplexityData const &c2, bool onlyInfo) {
+void assert_dataEqual(ComplexityData<> const &c1, ComplexityData<> const &c2, bool onlyInfo) {
   mu_assert_eq(c1.name, c2.name, "Names not equal!");
   mu_assert_eq(c1.len, c2.len, "Length not equal!");
   mu_assert_eq(c1.gc, c2.gc, "GC not equal!");
@@ -20,6 +32,12 @@ void assert_dataEqual(ComplexityData const &c1, ComplexityData const &c2, bool o
     mu_assert_eq(c1.regions[j].second, c2.regions[j].second, "Region not equal");
   }
   mu_assert_eq(c1.numbad, c2.numbad, "Numbad not equal");
+  mu_assert_eq(c1.regionStats.size(), c2.regionStats.size(), "Num. of region stats not equal");
+  for (size_t j=0; j<c1.regionStats.size(); j++) {
+    mu_assert_eq(c1.regionStats[j].facts, c2.regionStats[j].facts, "Region factors not equal");
+    mu_assert_eq(c1.regionStats[j].numbad, c2.regionStats[j].numbad, "Region numbad not equal");
+    mu_assert_eq(c1.regionStats[j].badivs, c2.regionStats[j].badivs, "Region bad ivs not equal");
+  }
   if (onlyInfo)
     return;
 
@@ -29,9 +47,9 @@ void assert_dataEqual(ComplexityData const &c1, ComplexityData const &c2, bool o
     mu_assert_eq(c1.bad[j].second, c2.bad[j].second, "bad interval not equal");
   }
 
-  mu_assert_eq(c1.mlf.size(), c2.mlf.size(), "Num. of MLF not equal");
-  for (size_t j=0; j<c1.mlf.size(); j++)
-    mu_assert_eq(c1.mlf[j], c2.mlf[j], "MLF not equal");
+  mu_assert_eq(c1.factBits.size(), c2.factBits.size(), "Factor bit vector sizes not equal");
+  for (size_t j=0; j<=c1.factBits.size(); j++)
+    mu_assert_eq(c1.factBits.rank(j), c2.factBits.rank(j), "Factor rank not equal");
 }
 
 void test_saveLoadData() {
@@ -45,7 +63,7 @@ void test_saveLoadData() {
   ff.seqs.push_back(seq2);
 
   //create index file
-  ComplexityData datJ;
+  ComplexityData<> datJ;
   extractData(datJ,ff);
   mu_assert_eq((size_t)2, datJ.regions.size(), "wrong number of regions");
   mu_assert_eq(ff.filename, datJ.name, "wrong sequence name");
@@ -54,20 +72,20 @@ void test_saveLoadData() {
 
   //try loading and check
   cerr << "load complete..." << endl;
-  ComplexityData datJ2;
+  ComplexityData<> datJ2;
   loadData(datJ2, iname, false);
   assert_dataEqual(datJ, datJ2, false);
 
   //try loading only info and check
   cerr << "load info..." << endl;
-  datJ2 = ComplexityData();
+  datJ2 = ComplexityData<>();
   loadData(datJ2, iname, true);
   assert_dataEqual(datJ, datJ2, true);
 
   cerr << "rename regions..." << endl;
   vector<string> nn{"renamed1","renamed2"};
   renameRegions(iname, nn);
-  ComplexityData datJ3;
+  ComplexityData<> datJ3;
   loadData(datJ3, iname, true);
   mu_assert_eq(datJ3.labels[0], nn[0], "wrong renamed name!");
   mu_assert_eq(datJ3.labels[1], nn[1], "wrong renamed name!");
@@ -75,7 +93,385 @@ void test_saveLoadData() {
   remove(iname);
 }
 
+// data extracted with 32 bit indices equals the one with 64 bit indices
+void test_extractIdx32() {
+  FastaSeq seq1("seq1","comment","NNNNNATATATGCGCGCATGCATGCNNNNN");
+  FastaSeq seq2("seq2","comment","NNNNNNNNNNNATCGACATGCTANNNNGTGAGTCTANNNN");
+  FastaFile ff;
+  ff.filename = "seq.fa";
+  ff.seqs.push_back(seq1);
+  ff.seqs.push_back(seq2);
+  FastaFile ff2 = ff;
+
+  ComplexityData<uint32_t> dat32;
+  ComplexityData<uint64_t> dat64;
+  extractData(dat32, ff);
+  extractData(dat64, ff2);
+  mu_assert_eq(dat64.len, dat32.len, "Length not equal!");
+  mu_assert_eq(dat64.numbad, dat32.numbad, "Numbad not equal");
+  mu_assert_eq(dat64.factBits.size(), dat32.factBits.size(), "Factor bit vector sizes not equal");
+  for (size_t j=0; j<=dat64.factBits.size(); j++)
+    mu_assert_eq(dat64.factBits.rank(j), dat32.factBits.rank(j), "Factor rank not equal");
+}
+
+// version 2 index is used from the mapped file, version 1 is still readable
+void test_loadVersions() {
+  char const* iname = "_tmp_test.idx";
+  FastaFile ff("Data/test.fasta");
+  ComplexityData<> dat;
+  extractData(dat, ff);
+  saveData(dat, iname);
+
+  ComplexityData<> dat2;
+  mu_assert(loadData(dat2, iname, false), "loading version 2 failed");
+  assert_dataEqual(dat, dat2, false);
+  mu_assert(dat2.factBits.borrowed(), "factors not used from mapping");
+  mu_assert(dat2.bad.borrowed(), "bad intervals not used from mapping");
+
+  // the factor starts do not depend on the index type
+  ComplexityData<uint32_t> dat32;
+  mu_assert(loadData(dat32, iname, false), "loading version 2 failed");
+  mu_assert(dat32.factBits.borrowed(), "factors not used from mapping");
+  for (size_t j=0; j<=dat.factBits.size(); j++)
+    mu_assert_eq(dat.factBits.rank(j), dat32.factBits.rank(j), "Factor rank not equal");
+  remove(iname);
+
+  ComplexityData<> dat1;
+  mu_assert(loadData(dat1, "Data/test_v1.idx", false), "loading version 1 failed");
+  dat1.name = dat.name;
+  assert_dataEqual(dat, dat1, false);
+  mu_assert(!dat1.factBits.borrowed(), "version 1 factors not copied");
+}
+
+// compressed arrays: access, search and serialization
+void test_deltaVec() {
+  vector<uint64_t> v;
+  uint64_t x = 0;
+  for (size_t i = 0; i < 1000; i++) {
+    x += i % 7 == 0 ? 0 : i % 100 == 0 ? (1ULL << 40) : i % 13;
+    v.push_back(x);
+  }
+  DeltaVec d(v);
+  mu_assert_eq(v.size(), d.size(), "wrong size");
+  for (size_t i = 0; i < v.size(); i++)
+    mu_assert_eq(v[i], d[i], "wrong value at " << i);
+  for (size_t i = 0; i < v.size(); i++)
+    for (uint64_t y : {v[i] - 1, v[i], v[i] + 1}) {
+      size_t lb = lower_bound(v.begin(), v.end(), y) - v.begin();
+      mu_assert_eq(lb, d.lowerBound(y), "wrong lower bound for " << y);
+    }
+  mu_assert_eq(v.size(), d.lowerBound(v.back() + 1), "wrong lower bound past end");
+
+  stringstream ss;
+  d.write(ss);
+  string buf = ss.str();
+  mu_assert_eq(d.bytes(), buf.size(), "wrong number of bytes written");
+  vector<uint64_t> aligned(buf.size() / 8 + 1);
+  memcpy(aligned.data(), buf.data(), buf.size());
+  DeltaVec d2;
+  mu_assert(DeltaVec::borrow((char const *)aligned.data(), buf.size(), nullptr, d2), "borrow failed");
+  mu_assert(!DeltaVec::borrow((char const *)aligned.data(), buf.size() - 1, nullptr, d2),
+            "truncated data accepted");
+  DeltaVec::borrow((char const *)aligned.data(), buf.size(), nullptr, d2);
+  d2.decode(300, 700, [&](size_t i, uint64_t y) { mu_assert_eq(v[i], y, "wrong value at " << i); });
+}
+
+// rank over factor starts compared to counting
+void test_rankBitVec() {
+  vector<size_t> pos;
+  for (size_t i = 0; i < 3000; i += 1 + (i * 7919) % 23)
+    pos.push_back(i);
+  for (size_t n : {pos.back() + 1, (size_t)3000, (size_t)3072}) {
+    RankBitVec bv(n, pos);
+    mu_assert_eq(n, bv.size(), "wrong size");
+    size_t cnt = 0, next = 0;
+    for (size_t i = 0; i <= n; i++) {
+      mu_assert_eq((uint64_t)cnt, bv.rank(i), "wrong rank at " << i);
+      if (i < n) {
+        bool set = next < pos.size() && pos[next] == i;
+        mu_assert_eq(set, bv[i], "wrong bit at " << i);
+        if (set) {
+          cnt++;
+          next++;
+        }
+      }
+    }
+
+    stringstream ss;
+    bv.write(ss);
+    string buf = ss.str();
+    mu_assert_eq(bv.bytes(), buf.size(), "wrong number of bytes written");
+    vector<uint64_t> aligned(buf.size() / 8);
+    memcpy(aligned.data(), buf.data(), buf.size());
+    RankBitVec bv2;
+    mu_assert(RankBitVec::borrow((char const *)aligned.data(), buf.size(), nullptr, bv2),
+              "borrow failed");
+    for (size_t i = 0; i <= n; i++)
+      mu_assert_eq(bv.rank(i), bv2.rank(i), "wrong rank after borrow at " << i);
+  }
+}
+
+// compressed index gives the same data
+size_t fileSize(char const *file) {
+  ifstream f(file, ios::binary | ios::ate);
+  return f.tellg();
+}
+
+void test_saveLoadCompressed() {
+  char const* iname = "_tmp_test.idx";
+  FastaFile ff("Data/test.fasta");
+  ComplexityData<> dat;
+  extractData(dat, ff);
+  saveData(dat, iname, true);
+  ComplexityData<> dat2;
+  mu_assert(loadData(dat2, iname, false), "loading compressed index failed");
+  assert_dataEqual(dat, dat2, false);
+  mu_assert(!dat2.factBits.borrowed(), "factors not rebuilt from packed positions");
+  // the factors are stored only once in each format
+  size_t packedSize = fileSize(iname);
+  saveData(dat, iname, false);
+  mu_assert(fileSize(iname) < packedSize + dat.factBits.bytes(), "factors stored twice");
+  remove(iname);
+}
+
+// sequences read straight into the doubled text give the same data
+void test_concatFasta() {
+  FastaFile ff("Data/test.fasta");
+  FastaFile ffc("Data/test.fasta", true);
+  mu_assert(!ffc.failed, "reading FASTA failed");
+  mu_assert_eq(ff.seqs.size(), ffc.regions.size(), "wrong number of regions!");
+  string all;
+  for (size_t i = 0; i < ff.seqs.size(); i++) {
+    mu_assert_eq(ff.seqs[i].name, ffc.seqs[i].name, "wrong name!");
+    mu_assert_eq(all.size(), ffc.regions[i].first, "wrong region start!");
+    mu_assert_eq(ff.seqs[i].seq.size(), ffc.regions[i].second, "wrong region length!");
+    all += ff.seqs[i].seq;
+  }
+  mu_assert_eq(all, string(ffc.text.get(), ffc.len), "wrong concatenated text!");
+  ComplexityData<> dat, datc;
+  extractData(dat, ff);
+  extractData(datc, ffc);
+  assert_dataEqual(dat, datc, false);
+}
+
+// s parsed from a (mapped) file and by pfasta from a named pipe
+pair<FastaFile, FastaFile> parseBoth(string const &s, bool concat) {
+  char const *fname = "_tmp_test.fa", *pname = "_tmp_test.pipe";
+  {
+    ofstream f(fname, ios::binary);
+    f << s;
+  }
+  remove(pname);
+  mkfifo(pname, 0600);
+  thread writer([&] {
+    ofstream f(pname, ios::binary);
+    f << s;
+  });
+  auto ret = make_pair(FastaFile(fname, concat), FastaFile(pname, concat));
+  writer.join();
+  remove(fname);
+  remove(pname);
+  return ret;
+}
+
+// the mapped parser gives the same sequences, or the same message, as pfasta
+void test_malformedFasta() {
+  vector<string> inputs = {">a\nACGT\n\n>b\nAC\n",   ">a c\nAC\nGT\n>b\nTT",
+                           ">a\n\n>b\nACGT\n",        ">a\nACGT\nAC GT\n",
+                           ">a\nACGT\nAC#GT\n",        "ACGT\n",
+                           ">a\nACGT\n\nACGT\n",      ">a\r\nACGT\r\n",
+                           ">a\nACGT\r\nACGT\r\n",    ">a\nACGT\n>b\n",
+                           ">a\nACGT\n>b",             ">a\nACGT\n>\nACGT\n",
+                           ">a comment",                 ">a\nACGT\n\n\n",
+                           ""};
+  for (auto const &s : inputs)
+    for (bool concat : {false, true}) {
+      auto ffs = parseBoth(s, concat);
+      FastaFile &fm = ffs.first, &fp = ffs.second;
+      mu_assert_eq(fp.failed, fm.failed, "failure differs for \"" << s << "\"");
+      mu_assert_eq(fp.error, fm.error, "message differs for \"" << s << "\"");
+      if (fp.failed)
+        continue;
+      mu_assert_eq(fp.seqs.size(), fm.seqs.size(), "number of sequences differs");
+      for (size_t i = 0; i < fp.seqs.size(); i++) {
+        mu_assert_eq(fp.seqs[i].name, fm.seqs[i].name, "name differs");
+        mu_assert_eq(fp.seqs[i].comment, fm.seqs[i].comment, "comment differs");
+        mu_assert_eq(fp.seqs[i].seq, fm.seqs[i].seq, "sequence differs");
+      }
+      mu_assert(fp.regions == fm.regions, "regions differ for \"" << s << "\"");
+      if (concat)
+        mu_assert_eq(string(fp.text.get(), fp.len), string(fm.text.get(), fm.len), "text differs");
+    }
+}
+
+// .2bit file of the sequences (N runs as N-blocks, lower case as mask
+// blocks), with the words byte swapped if swap is set
+string twoBitFile(vector<FastaSeq> const &seqs, bool swap) {
+  vector<uint32_t> w = {0x1A412743, 0, (uint32_t)seqs.size(), 0};
+  string head, recs;
+  size_t headsz = 16;
+  for (auto &sq : seqs)
+    headsz += 1 + sq.name.size() + 4;
+  auto put = [&](string &o, uint32_t x) {
+    x = swap ? __builtin_bswap32(x) : x;
+    o.append(reinterpret_cast<char const *>(&x), 4);
+  };
+  for (uint32_t x : w)
+    put(head, x);
+  for (auto &sq : seqs) {
+    head += (char)sq.name.size();
+    head += sq.name;
+    put(head, headsz + recs.size());
+    // runs of characters for which f is true
+    auto blocks = [&](bool (*f)(char)) {
+      vector<pair<uint32_t, uint32_t>> bs;
+      for (size_t i = 0; i < sq.seq.size(); i++)
+        if (f(sq.seq[i])) {
+          if (bs.empty() || bs.back().first + bs.back().second != i)
+            bs.push_back(make_pair(i, 0));
+          bs.back().second++;
+        }
+      return bs;
+    };
+    put(recs, sq.seq.size());
+    for (auto f : {+[](char c) { return c == 'N'; }, +[](char c) { return (bool)islower(c); }}) {
+      auto bs = blocks(f);
+      put(recs, bs.size());
+      for (auto &b : bs)
+        put(recs, b.first);
+      for (auto &b : bs)
+        put(recs, b.second);
+    }
+    put(recs, 0);
+    for (size_t i = 0; i < sq.seq.size(); i += 4) {
+      unsigned char x = 0;
+      for (size_t j = i; j < i + 4; j++)
+        x = x << 2 | (j < sq.seq.size() ? string("TCAG").find(toupper(sq.seq[j])) & 3 : 0);
+      recs += (char)x;
+    }
+  }
+  return head + recs;
+}
+
+// a .2bit file gives the same data as the FASTA sequences, its N-blocks are
+// the bad intervals
+void test_twoBit() {
+  char const *tname = "_tmp_test.2bit";
+  vector<FastaSeq> seqs = {FastaSeq("seq1", "", "NNNNNATATATGCGCGCATGCAtgcaNNNNN"),
+                           FastaSeq("seq2", "", "NNNNNNNNNNNATCGACATGCTANNNNGTGAGTCTANNNN"),
+                           FastaSeq("seq3", "", "acgtNNNACGT" + randSeq(1000))};
+  vector<FastaSeq> up = seqs;
+  for (auto &sq : up)
+    for (char &c : sq.seq)
+      c = toupper(c);
+  FastaFile ff;
+  ff.filename = tname;
+  ff.seqs = up;
+  ComplexityData<> dat;
+  extractData(dat, ff);
+  for (bool swap : {false, true}) {
+    with_file_out(tname, [&](ostream &o) {
+      o << twoBitFile(seqs, swap);
+      return true;
+    }, ios::binary);
+    FastaFile ft(tname, true);
+    mu_assert(!ft.failed, "reading .2bit failed");
+    mu_assert(ft.knownBad, "N-blocks not used");
+    FastaFile fs(tname);
+    mu_assert_eq(up.size(), fs.seqs.size(), "wrong number of sequences!");
+    for (size_t i = 0; i < up.size(); i++) {
+      mu_assert_eq(up[i].name, fs.seqs[i].name, "wrong name!");
+      mu_assert_eq(up[i].seq, fs.seqs[i].seq, "wrong sequence!");
+    }
+    ComplexityData<> datt;
+    extractData(datt, ft);
+    assert_dataEqual(dat, datt, false);
+  }
+  remove(tname);
+}
+
+// loading only a range gives its bad intervals and factor ranks
+void assert_rangeLoaded(ComplexityData<> const &dat, char const *iname, size_t from, size_t to) {
+  ComplexityData<> part;
+  mu_assert(loadData(part, iname, false, from, to), "loading range failed");
+  for (size_t i = from; i <= to; i++)
+    mu_assert_eq(dat.factBits.rank(i) - dat.factBits.rank(from),
+                 part.factBits.rank(i) - part.factBits.rank(from), "Factor rank not equal at " << i);
+  for (auto &b : dat.bad)
+    if (b.second >= from && b.first < to)
+      mu_assert(find(part.bad.begin(), part.bad.end(), b) != part.bad.end(),
+                "bad interval " << b.first << " missing");
+}
+
+void test_loadRange() {
+  char const* iname = "_tmp_test.idx";
+  FastaSeq seq1("seq1","comment","NNNNNATATATGCGCGCATGCATGCNNNNNATAGCCGATTTAGCAG");
+  FastaSeq seq2("seq2","comment","NNNNNNNNNNNATCGACATGCTANNNNGTGAGTCTANNNN");
+  FastaFile ff;
+  ff.seqs.push_back(seq1);
+  ff.seqs.push_back(seq2);
+  ComplexityData<> dat;
+  extractData(dat, ff);
+  for (bool compress : {false, true}) {
+    saveData(dat, iname, compress);
+    assert_rangeLoaded(dat, iname, 0, dat.len + 1);
+    for (auto &r : dat.regions)
+      assert_rangeLoaded(dat, iname, r.first, r.first + r.second);
+    assert_rangeLoaded(dat, iname, 20, 70);
+    assert_rangeLoaded(dat, iname, 7, 7);
+  }
+  remove(iname);
+
+  FastaFile ff2("Data/test.fasta");
+  ComplexityData<> dat2;
+  extractData(dat2, ff2);
+  assert_rangeLoaded(dat2, "Data/test_v1.idx", dat2.regions[1].first, dat2.len);
+  assert_rangeLoaded(dat2, "Data/test_v1.idx", 100, 1500);
+}
+
+// queries of a region behind the first give the same complexities when only
+// the region is loaded
+void test_queryRange() {
+  char const *iname = "_tmp_test.idx";
+  FastaFile ff("Data/test.fasta");
+  ComplexityData<> dat;
+  extractData(dat, ff);
+  MlNorm norm = mlNorm(dat);
+  vector<string> files = {"Data/test_v1.idx", iname};
+  for (bool compress : {false, true}) {
+    saveData(dat, iname, compress);
+    for (auto const &file : files)
+      for (size_t j = 1; j < dat.regions.size(); j++) {
+        size_t offset = dat.regions[j].first, n = dat.regions[j].second;
+        ComplexityData<> part;
+        mu_assert(loadData(part, file.c_str(), false, offset, offset + n), "loading range failed");
+        mu_assert(part.factBits.borrowed() || part.factBits.bytes() < dat.factBits.bytes(),
+                  "factors of the whole sequence built");
+        for (size_t w : {n, (size_t)100, (size_t)7}) {
+          vector<double> y(numEntries(n, w, 3)), yp(y.size());
+          ostringstream log;
+          mlComplexity(offset, n, w, 3, y, dat, norm, log);
+          mlComplexity(offset, n, w, 3, yp, part, norm, log);
+          for (size_t i = 0; i < y.size(); i++)
+            mu_assert(y[i] == yp[i] || (isnan(y[i]) && isnan(yp[i])),
+                      "in " << file << " region " << j << " window " << i << " differs");
+        }
+      }
+  }
+  remove(iname);
+}
+
 void all_tests() {
   mu_run_test(test_saveLoadData);
+  mu_run_test(test_extractIdx32);
+  mu_run_test(test_loadVersions);
+  mu_run_test(test_deltaVec);
+  mu_run_test(test_rankBitVec);
+  mu_run_test(test_saveLoadCompressed);
+  mu_run_test(test_loadRange);
+  mu_run_test(test_queryRange);
+  mu_run_test(test_concatFasta);
+  mu_run_test(test_malformedFasta);
+  mu_run_test(test_twoBit);
 }
 RUN_TESTS(all_tests)
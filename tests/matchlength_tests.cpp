@@ -1,8 +1,11 @@
 #include "minunit.h"
+#include <fstream>
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "esa.h"
+#include "extsa.h"
 #include "matchlength.h"
 #include "util.h"
 
@@ -22,8 +25,8 @@ static string factors2[] = {
 
 void checkML(string seq, string facts[], size_t num) {
   string s = seq + "$" + revComp(seq) + "$";
-  Esa esa(s.c_str(), s.size()); // calculate esa, both strands
-  Fact mlf;
+  Esa<> esa(s.c_str(), s.size()); // calculate esa, both strands
+  Fact<> mlf;
   computeMLFact(mlf, esa);
   cout << s << endl;
   mlf.print();
@@ -31,13 +34,116 @@ void checkML(string seq, string facts[], size_t num) {
 
   for (size_t i = 0; i < mlf.fact.size(); i++)
     mu_assert_eq(facts[i], string(mlf.str + mlf.fact[i], mlf.factLen(i)), "wrong factor");
+
+  // factorization straight from PLCP must give the same factors
+  Fact<> mlfPlcp;
+  computeMLFactPlcp(mlfPlcp, s.c_str(), s.size(), getSa<uint64_t>(s.c_str(), s.size()));
+  mu_assert_eq(mlf.fact.size(), mlfPlcp.fact.size(), "wrong number of PLCP ML factors");
+  for (size_t i = 0; i < mlf.fact.size(); i++)
+    mu_assert_eq(mlf.fact[i], mlfPlcp.fact[i], "wrong PLCP factor");
+}
+
+// both factorizations agree on random sequences
+void test_MatchLengthPlcp() {
+  for (size_t n : {10, 100, 1000, 10000}) {
+    string seq = randSeq(n, "ACGTN");
+    string s = seq + "$" + revComp(seq) + "$";
+    Esa<> esa(s.c_str(), s.size());
+    Fact<> mlf;
+    Fact<uint32_t> mlfPlcp;
+    computeMLFact(mlf, esa);
+    computeMLFactPlcp(mlfPlcp, s.c_str(), s.size(), getSa<uint32_t>(s.c_str(), s.size()));
+    mu_assert_eq(mlf.fact.size(), mlfPlcp.fact.size(), "wrong number of PLCP ML factors");
+    for (size_t i = 0; i < mlf.fact.size(); i++)
+      mu_assert_eq((uint64_t)mlf.fact[i], (uint64_t)mlfPlcp.fact[i], "wrong PLCP factor");
+
+    // same factors when built with several threads
+    Fact<> mlfThreads;
+    computeMLFactPlcp(mlfThreads, s.c_str(), s.size(), getSa<uint64_t>(s.c_str(), s.size()), 4);
+    mu_assert_eq(mlf.fact.size(), mlfThreads.fact.size(), "wrong number of threaded ML factors");
+    for (size_t i = 0; i < mlf.fact.size(); i++)
+      mu_assert_eq((uint64_t)mlf.fact[i], (uint64_t)mlfThreads.fact[i], "wrong threaded factor");
+  }
 }
 
 void test_MatchLength1() { return checkML(seq1, factors1, 7); }
 void test_MatchLength2() { return checkML(seq2, factors2, 13); }
 
+// factorization from scratch files equals the in-memory one
+void test_MatchLengthExt() {
+  string rep = randSeq(500);
+  vector<string> seqs = {seq1, seq2, randSeq(5000, "ACGTN"),
+                         rep + string(2000, 'N') + rep + randSeq(100) + rep};
+  for (auto &seq : seqs) {
+    string s = seq + "$" + revComp(seq) + "$";
+    Fact<> mlf, mlfExt;
+    computeMLFactPlcp(mlf, s.c_str(), s.size(), getSa<uint64_t>(s.c_str(), s.size()));
+    for (size_t mem : {256, 4096, 1 << 20}) {
+      ExtSa ext;
+      bool ok = buildExtSa(ext, s.c_str(), s.size(), mem, "/tmp") &&
+                computeMLFactExt(mlfExt, ext, s.c_str(), mem);
+      removeExtSa(ext);
+      mu_assert(ok, "building from scratch files failed");
+      mu_assert_eq(mlf.fact.size(), mlfExt.fact.size(), "wrong number of ML factors");
+      for (size_t i = 0; i < mlf.fact.size(); i++)
+        mu_assert_eq((uint64_t)mlf.fact[i], (uint64_t)mlfExt.fact[i], "wrong factor");
+    }
+  }
+}
+
+// read a scratch file of n values
+static vector<uint64_t> readScratch(string const &file, size_t n) {
+  vector<uint64_t> v(n);
+  ifstream f(file, ios::binary);
+  f.read((char *)v.data(), n * sizeof(uint64_t));
+  return v;
+}
+
+// suffix and LCP array in scratch files equal the in-memory ones, also with
+// long runs (placed by run length) and periodic repeats (keys extended)
+void test_ExtSa() {
+  string rep = randSeq(300), a40(40, 'A'), runs;
+  for (size_t i = 0; i < 20; i++)
+    runs += string(32 + i % 5, "ACGT"[i % 4]) + randSeq(i % 3) + a40;
+  vector<string> seqs = {randSeq(3000, "ACGTN"),
+                         string(100, 'N') + rep + string(2000, 'N') + rep + string(35, 'N'),
+                         a40 + "C" + a40 + "G" + a40 + "N" + string(50, 'A') + "C" + a40 +
+                             "C" + string(33, 'A') + "T" + string(100, 'T') + a40,
+                         runs};
+  string period;
+  for (size_t i = 0; i < 400; i++)
+    period += "AC";
+  seqs.push_back(period + "G" + period + "T" + randSeq(200) + period);
+  seqs.push_back(string(2000, 'A') + "CGCGGCGCG" + string(1000, 'A'));
+  for (auto &seq : seqs) {
+    string s = seq + "$" + revComp(seq) + "$";
+    Esa<> esa(s.c_str(), s.size());
+    for (size_t mem : {256, 4096, 1 << 16}) {
+      ExtSa ext;
+      mu_assert(buildExtSa(ext, s.c_str(), s.size(), mem, "/tmp", 2), "building failed");
+      vector<uint64_t> sa = readScratch(ext.saFile, s.size());
+      vector<uint64_t> lcp = readScratch(ext.lcpFile, s.size());
+      removeExtSa(ext);
+      for (size_t i = 0; i < s.size(); i++) {
+        mu_assert_eq((uint64_t)esa.sa[i], sa[i], "wrong suffix at " << i << " mem " << mem);
+        mu_assert_eq((uint64_t)esa.lcp[i], lcp[i], "wrong LCP at " << i << " mem " << mem);
+      }
+    }
+  }
+
+  // errors are reported, not fatal
+  ExtSa ext;
+  string s = randSeq(100);
+  mu_assert(!buildExtSa(ext, s.c_str(), s.size(), 256, "/nonexistent/dir"),
+            "missing directory accepted");
+  removeExtSa(ext);
+}
+
 void all_tests() {
   mu_run_test(test_MatchLength1);
   mu_run_test(test_MatchLength2);
+  mu_run_test(test_MatchLengthPlcp);
+  mu_run_test(test_MatchLengthExt);
+  mu_run_test(test_ExtSa);
 }
 RUN_TESTS(all_tests)
@@ -0,0 +1,230 @@
+#include "minunit.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <vector>
+using namespace std;
+
+#include "output.h"
+#include "util.h"
+
+string printfFixed(double x, int prec) {
+  char tmp[512];
+  snprintf(tmp, sizeof(tmp), "%.*f", prec, x);
+  return tmp;
+}
+
+// formatted numbers are the same as with printf, also for halfway cases
+void test_putFixed() {
+  vector<double> xs = {0, -0.0, 1, -1, 0.5, 0.00005, 0.00015, 0.12345, 2.5e-5, -1e-5,
+                       0.99995, 9.99995, 123456.78905, 1e10, 1e20, -3e300, 1e-300,
+                       numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(),
+                       numeric_limits<double>::quiet_NaN()};
+  mt19937 rng(42);
+  uniform_real_distribution<double> dist(-2, 2);
+  for (size_t i = 0; i < 10000; i++)
+    xs.push_back(dist(rng));
+  for (size_t i = 0; i < 10000; i++) // exactly on the decimal grid
+    xs.push_back((double)(rng() % 200000) / 10000.0);
+  for (int prec : {0, 1, 4, 9, 12}) {
+    OutBuf os(prec);
+    for (double x : xs) {
+      os.clear();
+      os.putFixed(x);
+      mu_assert_eq(printfFixed(x, prec), os.str(), "wrong format of " << x << " with " << prec);
+    }
+  }
+}
+
+void test_putUInt() {
+  OutBuf os;
+  for (uint64_t x : {(uint64_t)0, (uint64_t)7, (uint64_t)10, (uint64_t)1234567890,
+                     numeric_limits<uint64_t>::max()}) {
+    os.clear();
+    os.putUInt(x);
+    mu_assert_eq(to_string(x), os.str(), "wrong format of " << x);
+  }
+}
+
+// equal neighbouring values are merged, bad windows are gaps
+void test_bedGraph() {
+  ResultMat ys = {{"a", {0.5, 0.50001, 0.7, -1, -1, 0.7, 0.7, 0.2}}};
+  vector<TrackSeq> seqs = {{"s1", 100, 0, 5, 15}, {"s2", 35, 5, 3, 3}};
+  ostringstream out;
+  writeBedGraph(out, ys, seqs, 10, 4);
+  string exp = "track type=bedGraph name=\"a\"\n"
+               "s1\t10\t30\t0.5000\n"
+               "s1\t30\t40\t0.7000\n"
+               "s2\t0\t18\t0.7000\n"
+               "s2\t18\t28\t0.2000\n";
+  mu_assert_eq(exp, out.str(), "wrong bedGraph!");
+}
+
+// read-only access to a memory mapped track file, following the format
+// described in output.cpp
+class TrackFile {
+public:
+  size_t k = 0;                   // window interval
+  size_t levels = 0;              // number of zoom levels
+  vector<string> names;           // column names
+  vector<size_t> ws;              // window size of each column
+  vector<TrackSeq> seqs;
+
+  // returns false if the file can not be read or is no valid track file
+  bool open(char const *file) {
+    map = map_file(file);
+    if (!map)
+      return false;
+    size_t p = 8;
+    uint64_t bom, kk, nseqs;
+    uint32_t cols, lvls;
+    if (map->sz < p || string(map->dat, p) != "MACLETRK" || !get(p, bom) ||
+        bom != 0x0102030405060708ULL || !get(p, cols) || !get(p, lvls) || !get(p, kk) ||
+        !get(p, nseqs) || nseqs > map->sz)
+      return false;
+    k = kk;
+    levels = lvls;
+    names.resize(cols);
+    ws.resize(cols);
+    for (size_t c = 0; c < cols; c++) {
+      uint64_t w;
+      if (!get(p, w) || !getName(p, names[c]))
+        return false;
+      ws[c] = w;
+    }
+    seqs.resize(nseqs);
+    size_t first = 0;
+    for (auto &sq : seqs) {
+      uint64_t len, rows, center;
+      if (!get(p, len) || !get(p, rows) || !get(p, center) || !getName(p, sq.name))
+        return false;
+      sq.len = len;
+      sq.first = first;
+      sq.rows = rows;
+      sq.center = center;
+      first += rows;
+    }
+    p = (p + 7) / 8 * 8;
+    offs.resize(nseqs * (levels + 1));
+    for (size_t s = 0; s < nseqs; s++)
+      for (size_t l = 0; l <= levels; l++) {
+        uint64_t &off = offs[s * (levels + 1) + l];
+        size_t sz = l ? numBins(s, l) * cols * sizeof(ZoomBin) : seqs[s].rows * cols * sizeof(float);
+        if (!get(p, off) || off > map->sz || sz > map->sz - off)
+          return false;
+      }
+    return true;
+  }
+
+  float value(size_t seq, size_t row, size_t col) const {
+    float x;
+    memcpy(&x, map->dat + offs[seq * (levels + 1)] + (row * names.size() + col) * sizeof(float),
+           sizeof(x));
+    return x;
+  }
+  // number of bins of ZOOM^level rows of a sequence (level > 0)
+  size_t numBins(size_t seq, size_t level) const {
+    size_t b = 1;
+    for (size_t l = 0; l < level; l++)
+      b *= ZOOM;
+    return (seqs[seq].rows + b - 1) / b;
+  }
+  ZoomBin bin(size_t seq, size_t level, size_t i, size_t col) const {
+    ZoomBin z;
+    memcpy(&z, map->dat + offs[seq * (levels + 1) + level] + (i * names.size() + col) * sizeof(ZoomBin),
+           sizeof(z));
+    return z;
+  }
+
+private:
+  shared_ptr<MMapReader> map;
+  vector<uint64_t> offs; // offset of each sequence and level
+
+  // read a value of type T at offset p of the mapping, false if out of range
+  template <typename T> bool get(size_t &p, T &x) const {
+    if (p + sizeof(T) > map->sz)
+      return false;
+    memcpy(&x, map->dat + p, sizeof(T));
+    p += sizeof(T);
+    return true;
+  }
+  bool getName(size_t &p, string &name) const {
+    uint32_t n;
+    if (!get(p, n) || p + n > map->sz)
+      return false;
+    name.assign(map->dat + p, n);
+    p += n;
+    return true;
+  }
+};
+
+// values and zoom bins read back from a track file
+void test_track() {
+  char const *tname = "_tmp_track.bin";
+  mt19937 rng(1);
+  ResultMat ys = {{"a", {}}, {"b", {}}};
+  for (size_t j = 0; j < 1000; j++) {
+    ys[0].second.push_back(j % 7 ? (double)(rng() % 1000) / 500 : -1);
+    ys[1].second.push_back((double)(rng() % 1000) / 500);
+  }
+  vector<TrackSeq> seqs = {{"s1", 10000, 0, 300, 50}, {"s2", 100000, 300, 700, 50}};
+  vector<size_t> ws = {10, 100};
+  for (bool zoom : {false, true}) {
+    {
+      ofstream f(tname, ios::binary);
+      writeTrack(f, ys, ws, seqs, 10, zoom);
+    }
+    TrackFile tf;
+    mu_assert(tf.open(tname), "could not open track file!");
+    mu_assert_eq((size_t)10, tf.k, "wrong interval!");
+    mu_assert_eq(zoom ? (size_t)5 : (size_t)0, tf.levels, "wrong number of levels!");
+    mu_assert_eq((size_t)2, tf.names.size(), "wrong number of columns!");
+    mu_assert_eq(string("b"), tf.names[1], "wrong column name!");
+    mu_assert_eq((size_t)100, tf.ws[1], "wrong window size!");
+    mu_assert_eq((size_t)2, tf.seqs.size(), "wrong number of sequences!");
+    for (size_t s = 0; s < seqs.size(); s++) {
+      mu_assert_eq(seqs[s].name, tf.seqs[s].name, "wrong sequence name!");
+      mu_assert_eq(seqs[s].rows, tf.seqs[s].rows, "wrong number of rows!");
+      mu_assert_eq(seqs[s].first, tf.seqs[s].first, "wrong first row!");
+      for (size_t c = 0; c < 2; c++) {
+        auto &y = ys[c].second;
+        for (size_t j = 0; j < seqs[s].rows; j++)
+          mu_assert_eq((float)y[seqs[s].first + j], tf.value(s, j, c), "wrong value!");
+        for (size_t l = 1, bsz = ZOOM; l <= tf.levels; l++, bsz *= ZOOM) {
+          for (size_t i = 0; i < tf.numBins(s, l); i++) {
+            ZoomBin z = tf.bin(s, l, i, c);
+            uint32_t valid = 0;
+            float mx = -1;
+            double sum = 0;
+            for (size_t j = i * bsz; j < min(seqs[s].rows, (i + 1) * bsz); j++) {
+              float x = y[seqs[s].first + j];
+              if (x < 0)
+                continue;
+              valid++;
+              mx = max(mx, x);
+              sum += x;
+            }
+            mu_assert_eq(valid, z.valid, "wrong count in bin " << i << " of level " << l);
+            if (valid)
+              mu_assert_eq(mx, z.max, "wrong maximum in bin " << i << " of level " << l);
+            mu_assert(fabs(sum - z.sum) < 1e-3, "wrong sum in bin " << i << " of level " << l);
+          }
+        }
+      }
+    }
+  }
+  remove(tname);
+}
+
+void all_tests() {
+  mu_run_test(test_putFixed);
+  mu_run_test(test_putUInt);
+  mu_run_test(test_bedGraph);
+  mu_run_test(test_track);
+}
+RUN_TESTS(all_tests)
@@ -1,13 +1,22 @@
 #include "minunit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
 #include <string>
+#include <vector>
 using namespace std;
 
 #include "index.h"
 #include "complexity.h"
+#include "parallel.h"
+#include "util.h"
 
 ResultMat ys;
 FastaFile ff;
-ComplexityData datJ;
+ComplexityData<> datJ;
+string textJ; // joined sequences of datJ
 
 // macle seq.fa, macle -j seq.fa
 void test_global_no_settings() {
@@ -34,6 +43,152 @@ void test_global_with_settings() {
   mu_assert_eq(datJ.labels[1]+" (MC)", ys[0].first, "wrong header!");
 }
 
+// sliding windows give the same values with several threads
+void test_windows_threads() {
+  FastaFile ffl;
+  ffl.filename = "long.fa";
+  ffl.seqs.push_back(FastaSeq("seqA", "", randSeq(30000) + string(3000, 'N') + randSeq(20000)));
+  ffl.seqs.push_back(FastaSeq("seqB", "", randSeq(40000)));
+  ComplexityData<> dat;
+  extractData(dat, ffl);
+  for (auto task : {Task(-1, 0, 0), Task(1, 100, 30000)}) {
+    size_t w = 50, k = 3;
+    args.threads = 1;
+    ResultMat ys1 = calcComplexities(w, k, task, dat);
+    w = 50, k = 3;
+    args.threads = 4;
+    ResultMat ys4 = calcComplexities(w, k, task, dat);
+    args.threads = 1;
+    mu_assert_eq(ys1[0].second.size(), ys4[0].second.size(), "wrong number of entries!");
+    for (size_t j = 0; j < ys1[0].second.size(); j++)
+      mu_assert_eq(ys1[0].second[j], ys4[0].second[j], "window " << j << " differs!");
+  }
+}
+
+// exactly the windows with more than 5% bad nucleotides are ignored
+void test_bad_windows() {
+  string seq;
+  for (size_t gap : {1, 2, 3, 5, 8, 13, 40})
+    seq += randSeq(300) + string(gap, 'N');
+  FastaFile ffl;
+  ffl.seqs.push_back(FastaSeq("seqA", "", seq));
+  ComplexityData<> dat;
+  extractData(dat, ffl);
+  size_t w = 60, k = 1;
+  ResultMat ys1 = calcComplexities(w, k, Task(-1, 0, 0), dat);
+  for (size_t j = 0; j < ys1[0].second.size(); j++) {
+    size_t bad = 0;
+    for (size_t i = j * k; i < j * k + w; i++)
+      bad += seq[i] == 'N';
+    mu_assert_eq(bad > 3, ys1[0].second[j] == -1, "window " << j << " with " << bad << " bad");
+  }
+}
+
+// several window sizes are aligned at the centers of the biggest windows
+void test_window_sizes() {
+  FastaFile ffl;
+  ffl.seqs.push_back(FastaSeq("seqA", "", randSeq(3000) + string(50, 'N') + randSeq(2000)));
+  ffl.seqs.push_back(FastaSeq("seqB", "", randSeq(4000)));
+  ComplexityData<> dat;
+  extractData(dat, ffl);
+  for (auto task : {Task(-1, 0, 0), Task(1, 0, 0), Task(0, 10, 4000)}) {
+    vector<size_t> ws = {50, 200};
+    size_t k = 5;
+    ResultMat ysw = calcComplexities(ws, k, task, dat);
+    mu_assert_eq((size_t)2, ysw.size(), "wrong number of columns!");
+    size_t w = 50;
+    ResultMat ys1 = calcComplexities(w, k, task, dat);
+    w = 200;
+    ResultMat ys2 = calcComplexities(w, k, task, dat);
+    mu_assert_eq(ys2[0].second.size(), ysw[1].second.size(), "wrong number of entries!");
+    for (size_t j = 0; j < ysw[0].second.size(); j++) { // shift of (200-50)/2 = 15 windows
+      mu_assert_eq(ys1[0].second[j + 15], ysw[0].second[j], "small window " << j << " differs!");
+      mu_assert_eq(ys2[0].second[j], ysw[1].second[j], "big window " << j << " differs!");
+    }
+  }
+}
+
+// whole region queries from the region statistics equal the computed ones
+void test_region_stats() {
+  mu_assert_eq(datJ.regions.size(), datJ.regionStats.size(), "wrong number of region stats!");
+  // the gap at the end of the first region continues in the second one
+  mu_assert_eq((uint64_t)10, datJ.regionStats[0].numbad, "wrong bad count of region!");
+  mu_assert_eq((uint64_t)19, datJ.regionStats[1].numbad, "wrong bad count of region!");
+  for (size_t j = 0; j < datJ.regions.size(); j++)
+    mu_assert(datJ.regionStats[j].numbad <= datJ.regions[j].second,
+              "more bad nucleotides than region length in " << j);
+  ComplexityData<> noStats = datJ;
+  noStats.regionStats.clear();
+  for (int64_t j = 0; j < (int64_t)datJ.regions.size(); j++) {
+    size_t w = 0, k = 0;
+    ResultMat ys1 = calcComplexities(w, k, Task(j, 0, 0), datJ);
+    w = k = 0;
+    ResultMat ys2 = calcComplexities(w, k, Task(j, 0, 0), noStats);
+    mu_assert_eq(ys2[0].second[0], ys1[0].second[0], "wrong complexity from stats!");
+  }
+}
+
+// batch of ranges evaluated concurrently with a shared normalization
+void test_batch_threads() {
+  vector<Task> tasks; // enough for several chunks
+  for (int64_t r = -1; r < 2; r++) {
+    size_t len = r < 0 ? datJ.len : datJ.regions[r].second;
+    for (size_t s = 0; s < len; s++)
+      for (size_t e = s + 1; e < len; e++)
+        tasks.push_back(Task(r, s, e));
+  }
+  vector<double> ys1(tasks.size()), ys4(tasks.size());
+  for (size_t i = 0; i < tasks.size(); i++) {
+    size_t w = 0, k = 0;
+    ys1[i] = calcComplexities(w, k, tasks[i], datJ)[0].second[0];
+  }
+  MlNorm norm = mlNorm(datJ);
+  vector<string> logs(tasks.size());
+  parallelFor(tasks.size(), 4, [&](unsigned, size_t from, size_t to) {
+    vector<double> y(1);
+    for (size_t i = from; i < to; i++) {
+      ostringstream log;
+      auto iv = taskInterval(tasks[i], datJ);
+      mlComplexity(iv.first, iv.second, iv.second, iv.second, y, datJ, norm, log);
+      ys4[i] = y[0];
+      logs[i] = log.str();
+    }
+  });
+  for (size_t i = 0; i < tasks.size(); i++) {
+    mu_assert_eq(ys1[i], ys4[i], "task " << i << " differs!");
+    // the warning reports the share of valid DNA in the range
+    auto iv = taskInterval(tasks[i], datJ);
+    size_t bad = count(textJ.begin() + iv.first, textJ.begin() + iv.first + iv.second, 'N');
+    double fracbad = (double)bad / iv.second;
+    ostringstream warn;
+    if (fracbad > 0.05)
+      warn << "WARNING: only " << (1 - fracbad) * 100 << "% of sequence are valid DNA! ";
+    mu_assert_eq(warn.str(), logs[i].substr(0, warn.str().size()), "wrong warning for task " << i);
+    mu_assert_eq(warn.str().empty(), logs[i].empty(), "wrong warning for task " << i);
+  }
+}
+
+// the vectorized scaling gives the same bits as the scalar loop, also for
+// tails shorter than a vector, ignored windows and clamped values
+void test_scaleCounts() {
+  mt19937 rng(1);
+  for (size_t m = 0; m < 40; m++) {
+    vector<double> y(m);
+    for (auto &x : y)
+      x = rng() % 5 ? (double)(rng() % 30) : -1; // small counts go below cMin
+    vector<double> yc = y, yv = y;
+    scaleCounts(yc.data(), m, 20, 0.4, 0.3, false);
+    scaleCounts(yv.data(), m, 20, 0.4, 0.3, true);
+    mu_assert(m == 0 || !memcmp(yc.data(), yv.data(), m * sizeof(double)),
+              "results differ for " << m << " windows");
+    for (size_t j = 0; j < m; j++) {
+      mu_assert_eq(y[j] < 0, yc[j] < 0, "ignored window changed");
+      if (y[j] >= 0 && y[j] / 20 < 0.4)
+        mu_assert(yc[j] == 0 && !signbit(yc[j]), "negative value not clamped to 0");
+    }
+  }
+}
+
 void all_tests() {
   //construct a sequence file
   FastaSeq seq1("seq1","comment","NNNNNATATATGCGCGCATGCATGCNNNNN");
@@ -41,9 +196,16 @@ void all_tests() {
   ff.filename = "seq.fa";
   ff.seqs.push_back(seq1);
   ff.seqs.push_back(seq2);
+  textJ = seq1.seq + seq2.seq;
   extractData(datJ,ff);
 
   mu_run_test(test_global_no_settings);
   mu_run_test(test_global_with_settings);
+  mu_run_test(test_windows_threads);
+  mu_run_test(test_bad_windows);
+  mu_run_test(test_window_sizes);
+  mu_run_test(test_region_stats);
+  mu_run_test(test_batch_threads);
+  mu_run_test(test_scaleCounts);
 }
 RUN_TESTS(all_tests)
@@ -1,7 +1,12 @@
 #include "minunit.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <vector>
 using namespace std;
 
+#include "parallel.h"
 #include "util.h"
 
 void test_randSeq() {
@@ -38,8 +43,40 @@ void test_revComp() {
   mu_assert(result == "$gctaAAAAAAANNNNNNNCCCCCGGGT", "wrong reverse complement!");
 }
 
+// every job runs once, at most workers at once and within the budget unless
+// a job runs alone
+void test_jobPool() {
+  vector<size_t> cost = {5, 5, 5, 20, 1, 1, 4, 6, 3};
+  size_t budget = 10, used = 0, maxUsed = 0;
+  unsigned running = 0, maxRunning = 0;
+  vector<size_t> started;
+  mutex mtx;
+  jobPool(cost, budget, 3, [&](size_t i) {
+    {
+      lock_guard<mutex> lock(mtx);
+      started.push_back(i);
+      used += cost[i];
+      running++;
+      maxRunning = max(maxRunning, running);
+      if (running > 1)
+        maxUsed = max(maxUsed, used);
+    }
+    this_thread::sleep_for(chrono::milliseconds(10));
+    lock_guard<mutex> lock(mtx);
+    used -= cost[i];
+    running--;
+  });
+  mu_assert_eq(cost.size(), started.size(), "wrong number of jobs run!");
+  sort(started.begin(), started.end());
+  for (size_t i = 0; i < started.size(); i++)
+    mu_assert_eq(i, started[i], "job " << i << " not run once!");
+  mu_assert(maxRunning <= 3, "too many jobs at once!");
+  mu_assert(maxUsed <= budget, "budget exceeded!");
+}
+
 void all_tests() {
   mu_run_test(test_randSeq);
   mu_run_test(test_revComp);
+  mu_run_test(test_jobPool);
 }
 RUN_TESTS(all_tests)